@@ -15,7 +15,7 @@ int main()
 
   std::size_t total = 64;
   go([&, total](coro& c) {
-      char buf[64 * 1024];
+      char buf[64 * 1024] resumable_spill;
       tcp::socket conn(io_service);
       yield from conn.async_connect({address_v4::loopback(), 13375}, c);
       yield from async_read(conn, buffer(buf, total), c);
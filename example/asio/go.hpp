@@ -21,7 +21,7 @@ private:
   struct impl_base
   {
     virtual ~impl_base() {}
-    virtual void* wanted() = 0;
+    virtual void* wanted(resumable_type_id id) = 0;
     void (*resume_)(coro&);
   };
 
@@ -34,9 +34,9 @@ private:
       resume_ = &impl::resume;
     }
 
-    virtual void* wanted()
+    virtual void* wanted(resumable_type_id id)
     {
-      return ::wanted(f_);
+      return ::wanted(f_, id);
     }
 
     static void resume(coro& c)
@@ -134,10 +134,12 @@ public:
     return state_ == terminal;
   }
 
+#if __RESUMABLE_RTTI
   const std::type_info& wanted_type() const noexcept
   {
     return typeid(std::exception_ptr);
   }
+#endif // __RESUMABLE_RTTI
 
   void* wanted() noexcept
   {
@@ -166,8 +168,10 @@ public:
 
   void operator()(Args... args)
   {
-    static_cast<async_generator<Args...>*>(coro_.impl_->wanted())->result_ = std::make_tuple(args...);
-    static_cast<async_generator<Args...>*>(coro_.impl_->wanted())->state_ = async_generator<Args...>::ready;
+    async_generator<Args...>* g = static_cast<async_generator<Args...>*>(
+        coro_.impl_->wanted(resumable_type_id_of<async_generator<Args...>>()));
+    g->result_ = std::make_tuple(args...);
+    g->state_ = async_generator<Args...>::ready;
     coro_.impl_->resume_(coro_);
   }
 
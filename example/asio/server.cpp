@@ -13,7 +13,7 @@ void echo(tcp::socket sock)
 {
   go([sock=std::move(sock)](coro& c) resumable {
       std::size_t length;
-      char data[1024];
+      char data[1024] resumable_spill;
       for (;;)
       {
         length = yield from sock.async_read_some(buffer(data), c);
@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+#include <resumable/array.hpp>
+
+auto agent(unsigned seed)
+{
+  return [x = seed, energy = seed % 11]() resumable -> unsigned
+  {
+    for (;;)
+    {
+      while (energy > 0)
+      {
+        --energy;
+        x = x * 1103515245u + 12345u;
+        yield x & 1u;
+      }
+      energy = (x >> 8) & 15u;
+      yield 2u;
+      yield 3u;
+    }
+  };
+}
+
+typedef decltype(agent(0)) agent_type;
+typedef std::chrono::steady_clock clock_type;
+
+double elapsed_ns(clock_type::time_point start)
+{
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  std::size_t instances = argc > 1 ? std::atoi(argv[1]) : 200000;
+  int ticks = argc > 2 ? std::atoi(argv[2]) : 100;
+
+  // Individually allocated frames, visited in an order unrelated to their
+  // addresses, as they would be when owned by separate tasks.
+  std::vector<std::unique_ptr<agent_type>> scattered;
+  for (std::size_t i = 0; i < instances; ++i)
+    scattered.emplace_back(new agent_type(agent(i)));
+  std::shuffle(scattered.begin(), scattered.end(), std::mt19937(42));
+
+  unsigned long scattered_sum = 0;
+  clock_type::time_point start = clock_type::now();
+  for (int t = 0; t < ticks; ++t)
+    for (auto& a : scattered)
+      scattered_sum += (*a)();
+  double scattered_ns = elapsed_ns(start);
+
+  resumable_array<agent_type> array(instances);
+  for (std::size_t i = 0; i < instances; ++i)
+    array.emplace(agent(i));
+
+  unsigned long array_sum = 0;
+  start = clock_type::now();
+  for (int t = 0; t < ticks; ++t)
+    array.resume_all([&](std::size_t, unsigned r) { array_sum += r; });
+  double array_ns = elapsed_ns(start);
+
+  double resumes = static_cast<double>(instances) * ticks;
+  std::printf("vector<unique_ptr<F>>: %6.2f ns/resume (checksum %lu)\n", scattered_ns / resumes, scattered_sum);
+  std::printf("resumable_array<F>:    %6.2f ns/resume (checksum %lu)\n", array_ns / resumes, array_sum);
+}
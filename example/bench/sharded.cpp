@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <resumable/sharded.hpp>
+
+// Tokens are passed around rings of tasks. Each resume updates some state in
+// the task's frame and hands the token to the next task in the ring, which
+// is on the same shard most of the time and on the next shard every eighth
+// hop. The latency of a hop is the time from the post to the resume.
+
+typedef std::chrono::steady_clock clock_type;
+
+std::int64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      clock_type::now().time_since_epoch()).count();
+}
+
+struct ring_state
+{
+  ring_state(std::size_t f, std::size_t n, long hops)
+    : first(f), size(n), remaining(hops)
+  {
+  }
+
+  std::size_t first;
+  std::size_t size;
+  std::atomic<long> remaining;
+};
+
+struct env
+{
+  std::vector<std::int64_t> stamps;
+  std::vector<std::vector<float>> latencies;
+  std::function<void(std::size_t)> wake;
+};
+
+auto member(env& e, ring_state& r, std::size_t index)
+{
+  return [&e, &r, index, data = std::array<unsigned, 64>(), i = std::size_t(0)]() resumable -> unsigned
+  {
+    for (;;)
+    {
+      e.latencies[index].push_back(static_cast<float>(now_ns() - e.stamps[index]));
+      for (i = 0; i < data.size(); ++i)
+        data[i] = data[i] * 31u + static_cast<unsigned>(i);
+      if (r.remaining.fetch_sub(1, std::memory_order_relaxed) > 1)
+      {
+        std::size_t next = r.first + (index - r.first + 1) % r.size;
+        e.stamps[next] = now_ns();
+        e.wake(next);
+      }
+      yield data[0];
+    }
+  };
+}
+
+typedef decltype(member(std::declval<env&>(), std::declval<ring_state&>(), 0)) member_type;
+
+// The design being compared against: every thread takes tasks from one
+// queue under one lock, so a task runs on whichever thread is free. Tasks
+// are never resumed on two threads at once, as in the sharded scheduler.
+class shared_queue
+{
+public:
+  struct node
+  {
+    std::atomic<int> state{0};
+    node* next = nullptr;
+    void (*resume)(node&) = nullptr;
+  };
+
+  template <class F>
+  struct task : node, F
+  {
+    explicit task(F f)
+      : F(std::move(f))
+    {
+      resume = &invoke;
+    }
+
+    static void invoke(node& n)
+    {
+      static_cast<F&>(static_cast<task&>(n))();
+    }
+  };
+
+  explicit shared_queue(unsigned threads)
+  {
+    for (unsigned i = 0; i < threads; ++i)
+      threads_.emplace_back([this] { work(); });
+  }
+
+  ~shared_queue()
+  {
+    wait();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_)
+      t.join();
+  }
+
+  void post(node& n)
+  {
+    int s = n.state.load(std::memory_order_seq_cst);
+    for (;;)
+    {
+      if (s == idle)
+      {
+        if (n.state.compare_exchange_weak(s, queued, std::memory_order_seq_cst))
+          break;
+      }
+      else if (s == running)
+      {
+        if (n.state.compare_exchange_weak(s, notified, std::memory_order_seq_cst))
+          return;
+      }
+      else
+      {
+        return;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++active_;
+      push(&n);
+    }
+    cv_.notify_one();
+  }
+
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this] { return active_ == 0; });
+  }
+
+private:
+  enum { idle, queued, running, notified };
+
+  void push(node* n)
+  {
+    n->next = nullptr;
+    if (last_)
+      last_->next = n;
+    else
+      first_ = n;
+    last_ = n;
+  }
+
+  void work()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+      cv_.wait(lock, [this] { return first_ || stopping_; });
+      if (!first_)
+        return;
+      node* n = first_;
+      first_ = n->next;
+      if (!first_)
+        last_ = nullptr;
+      lock.unlock();
+
+      n->state.exchange(running, std::memory_order_seq_cst);
+      n->resume(*n);
+      int s = running;
+      bool done = n->state.compare_exchange_strong(s, idle, std::memory_order_acq_rel);
+      if (!done)
+        n->state.store(queued, std::memory_order_relaxed);
+
+      lock.lock();
+      if (!done)
+        push(n);
+      else if (--active_ == 0)
+        idle_cv_.notify_all();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable idle_cv_;
+  node* first_ = nullptr;
+  node* last_ = nullptr;
+  std::size_t active_ = 0;
+  bool stopping_ = false;
+};
+
+struct result
+{
+  double seconds;
+  std::vector<float> latencies;
+};
+
+// Builds the rings, starts one token on each, and waits for every ring to
+// use up its hops.
+template <class Tasks, class Post>
+result run(Tasks& tasks, env& e, std::deque<ring_state>& rings, Post post, std::function<void()> wait)
+{
+  e.wake = [&](std::size_t i) { post(i, tasks[i]); };
+
+  clock_type::time_point start = clock_type::now();
+  for (auto& r : rings)
+  {
+    e.stamps[r.first] = now_ns();
+    e.wake(r.first);
+  }
+  wait();
+
+  result res;
+  res.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+  for (auto& l : e.latencies)
+    res.latencies.insert(res.latencies.end(), l.begin(), l.end());
+  return res;
+}
+
+double percentile(std::vector<float>& v, double p)
+{
+  std::size_t k = static_cast<std::size_t>(p * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k] / 1000.0;
+}
+
+void report(const char* name, result& r)
+{
+  double hops = static_cast<double>(r.latencies.size());
+  std::printf("%-14s %10.0f hops/s  p50 %8.2f us  p99 %8.2f us  p99.9 %8.2f us\n",
+      name, hops / r.seconds,
+      percentile(r.latencies, 0.5),
+      percentile(r.latencies, 0.99),
+      percentile(r.latencies, 0.999));
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+  std::size_t count = argc > 2 ? std::atoi(argv[2]) : 4096;
+  long hops = argc > 3 ? std::atol(argv[3]) : 2000000;
+  std::size_t ring_size = 64;
+  if (threads == 0)
+    threads = 1;
+  count = std::max(count / ring_size, std::size_t(1)) * ring_size;
+
+  auto shard_of = [threads](std::size_t i) { return static_cast<unsigned>((i / 8) % threads); };
+
+  auto setup = [&](env& e, std::deque<ring_state>& rings)
+  {
+    e.stamps.assign(count, 0);
+    e.latencies.assign(count, std::vector<float>());
+    for (auto& l : e.latencies)
+      l.reserve(2 * hops / count + 16);
+    for (std::size_t f = 0; f < count; f += ring_size)
+      rings.emplace_back(f, ring_size, hops / static_cast<long>(count / ring_size));
+  };
+
+  {
+    env e;
+    std::deque<ring_state> rings;
+    setup(e, rings);
+    std::deque<shared_queue::task<member_type>> tasks;
+    for (std::size_t i = 0; i < count; ++i)
+      tasks.emplace_back(member(e, rings[i / ring_size], i));
+
+    shared_queue sched(threads);
+    result r = run(tasks, e, rings,
+        [&](std::size_t, shared_queue::node& n) { sched.post(n); },
+        [&] { sched.wait(); });
+    report("shared queue", r);
+  }
+
+  {
+    env e;
+    std::deque<ring_state> rings;
+    setup(e, rings);
+    std::deque<resumable_task<member_type>> tasks;
+    for (std::size_t i = 0; i < count; ++i)
+      tasks.emplace_back(member(e, rings[i / ring_size], i));
+
+    resumable_sharded_scheduler sched(threads);
+    result r = run(tasks, e, rings,
+        [&](std::size_t i, resumable_hook& h) { sched.post(shard_of(i), h); },
+        [&] { sched.wait(); });
+    report("sharded", r);
+  }
+}
@@ -0,0 +1,138 @@
+#ifndef RESUMABLE_ARENA_HPP
+#define RESUMABLE_ARENA_HPP
+
+#include <cstddef>
+#include <new>
+
+// A segmented stack allocator for frames whose lifetimes nest, such as the
+// sub-generators created by a recursive "yield from". Blocks are bumped off
+// the current segment and released in LIFO order. A block freed out of order
+// is only marked as free, and its space is reclaimed once everything above it
+// has been freed as well. One empty segment is kept in reserve so that a
+// traversal which repeatedly crosses a segment boundary does not thrash.
+//
+// An arena is only ever used by whoever it is handed to explicitly, such as
+// a resumable_generator constructed with one, which passes it on to the
+// generators it creates. Blocks must be freed to the arena they came from,
+// before it is destroyed, and on one thread at a time. Blocks are aligned for
+// any fundamental type.
+
+class resumable_arena
+{
+public:
+  explicit resumable_arena(std::size_t segment_size = 16 * 1024)
+    : segment_size_(segment_size)
+  {
+  }
+
+  resumable_arena(const resumable_arena&) = delete;
+  resumable_arena& operator=(const resumable_arena&) = delete;
+
+  ~resumable_arena()
+  {
+    while (segment_)
+    {
+      segment* prev = segment_->prev;
+      ::operator delete(segment_);
+      segment_ = prev;
+    }
+    ::operator delete(spare_);
+  }
+
+  void* allocate(std::size_t size)
+  {
+    block* b = segment_ ? push(segment_, size) : nullptr;
+    if (!b)
+      b = push(new_segment(size), size);
+    return b + 1;
+  }
+
+  void deallocate(void* p) noexcept
+  {
+    if (p)
+      release(static_cast<block*>(p) - 1);
+  }
+
+private:
+  struct segment
+  {
+    segment* prev;
+    char* top;
+    char* end;
+  };
+
+  struct alignas(std::max_align_t) block
+  {
+    block* prev;
+    segment* seg;
+    bool free;
+  };
+
+  static std::size_t round_up(std::size_t n) noexcept
+  {
+    const std::size_t a = alignof(block);
+    return (n + a - 1) / a * a;
+  }
+
+  static char* base(segment* s) noexcept
+  {
+    return reinterpret_cast<char*>(s) + round_up(sizeof(segment));
+  }
+
+  block* push(segment* s, std::size_t size) noexcept
+  {
+    std::size_t n = sizeof(block) + round_up(size);
+    if (static_cast<std::size_t>(s->end - s->top) < n)
+      return nullptr;
+    block* b = new (s->top) block{last_, s, false};
+    s->top += n;
+    last_ = b;
+    return b;
+  }
+
+  segment* new_segment(std::size_t size)
+  {
+    std::size_t capacity = sizeof(block) + round_up(size);
+    if (capacity < segment_size_)
+      capacity = segment_size_;
+
+    segment* s = spare_;
+    spare_ = nullptr;
+    if (!s || static_cast<std::size_t>(s->end - base(s)) < capacity)
+    {
+      ::operator delete(s);
+      void* p = ::operator new(round_up(sizeof(segment)) + capacity);
+      s = static_cast<segment*>(p);
+      s->end = base(s) + capacity;
+    }
+
+    s->prev = segment_;
+    s->top = base(s);
+    segment_ = s;
+    return s;
+  }
+
+  void release(block* b) noexcept
+  {
+    b->free = true;
+    while (last_ && last_->free)
+    {
+      block* top = last_;
+      last_ = top->prev;
+      top->seg->top = reinterpret_cast<char*>(top);
+      if (top->seg->top == base(top->seg))
+      {
+        segment_ = top->seg->prev;
+        ::operator delete(spare_);
+        spare_ = top->seg;
+      }
+    }
+  }
+
+  std::size_t segment_size_;
+  segment* segment_ = nullptr;
+  segment* spare_ = nullptr;
+  block* last_ = nullptr;
+};
+
+#endif // RESUMABLE_ARENA_HPP
@@ -0,0 +1,129 @@
+#ifndef RESUMABLE_ARRAY_HPP
+#define RESUMABLE_ARRAY_HPP
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Runs many instances of the same resumable lambda together. The frames are
+// stored contiguously, and their states are mirrored in a separate column.
+// Each tick buckets the live instances by state using only that column, then
+// resumes one bucket at a time, so consecutive resumes take the same path
+// through the dispatch switch and walk the frames in address order.
+//
+// Frames are moved when the array grows, so either reserve the capacity up
+// front or only add instances that are movable in every state.
+
+template <class F>
+class resumable_array
+{
+public:
+  typedef F value_type;
+  typedef decltype(std::declval<F&>()()) result_type;
+
+  resumable_array()
+  {
+  }
+
+  explicit resumable_array(std::size_t capacity)
+  {
+    frames_.reserve(capacity);
+    states_.reserve(capacity);
+    order_.reserve(capacity);
+  }
+
+  template <class... Args>
+  std::size_t emplace(Args&&... args)
+  {
+    frames_.emplace_back(std::forward<Args>(args)...);
+    states_.push_back(live_state(frames_.back()));
+    return frames_.size() - 1;
+  }
+
+  std::size_t size() const noexcept
+  {
+    return frames_.size();
+  }
+
+  F& operator[](std::size_t i) noexcept
+  {
+    return frames_[i];
+  }
+
+  const F& operator[](std::size_t i) const noexcept
+  {
+    return frames_[i];
+  }
+
+  int state(std::size_t i) const noexcept
+  {
+    return states_[i];
+  }
+
+  // Resumes every instance that has not terminated exactly once. The handler
+  // is called as h(index, result), or h(index) when the lambda returns void.
+  // Returns the number of instances resumed.
+  template <class Handler>
+  std::size_t resume_all(Handler&& h)
+  {
+    bucket();
+    for (std::size_t i : order_)
+    {
+      resume(i, h, std::is_void<result_type>());
+      states_[i] = live_state(frames_[i]);
+    }
+    return order_.size();
+  }
+
+private:
+  // A lambda that ends with "return from" keeps the state of that statement
+  // once it has finished, so terminated instances are found with
+  // is_terminal() and stored as -1.
+  static int live_state(const F& f) noexcept
+  {
+    return ::is_terminal(f) ? -1 : resumable_state(f);
+  }
+
+  template <class Handler>
+  void resume(std::size_t i, Handler& h, std::false_type)
+  {
+    h(i, frames_[i]());
+  }
+
+  template <class Handler>
+  void resume(std::size_t i, Handler& h, std::true_type)
+  {
+    frames_[i]();
+    h(i);
+  }
+
+  // A counting sort of the live instances by state. Terminated instances
+  // have state -1 and are left out.
+  void bucket()
+  {
+    int max_state = -1;
+    for (int s : states_)
+      if (s > max_state)
+        max_state = s;
+
+    starts_.assign(max_state + 2, 0);
+    for (int s : states_)
+      if (s >= 0)
+        ++starts_[s + 1];
+    for (std::size_t s = 1; s < starts_.size(); ++s)
+      starts_[s] += starts_[s - 1];
+
+    order_.resize(starts_.back());
+    for (std::size_t i = 0; i < states_.size(); ++i)
+      if (states_[i] >= 0)
+        order_[starts_[states_[i]]++] = i;
+  }
+
+  std::vector<F> frames_;
+  std::vector<int> states_;
+  std::vector<std::size_t> starts_;
+  std::vector<std::size_t> order_;
+};
+
+#endif // RESUMABLE_ARRAY_HPP
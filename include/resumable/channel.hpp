@@ -0,0 +1,331 @@
+#ifndef RESUMABLE_CHANNEL_HPP
+#define RESUMABLE_CHANNEL_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// A bounded, buffered channel between resumable lambdas on one thread.
+//
+// Values go through a ring buffer of Capacity elements, which must be a
+// power of two. An operation only suspends the lambda that started it when
+// it cannot go any further: a push when the buffer is full, and a pull when
+// it is empty. An operation that can complete straight away does so without
+// suspending at all.
+//
+//   resumable_channel<int, 1024> c;
+//
+//   auto producer = [&, batch = std::array<int, 4096>()]() resumable
+//   {
+//     for (;;)
+//     {
+//       fill(batch);
+//       yield from c.push_n(batch.data(), batch.size());
+//     }
+//   };
+//
+//   auto consumer = [&, batch = std::array<int, 4096>(), n = std::size_t(0)]() resumable
+//   {
+//     for (;;)
+//     {
+//       yield from c.pull_n(batch.data(), batch.size(), &n);
+//       use(batch.data(), n);
+//     }
+//   };
+//
+// push_n() returns once all n values are in the channel. pull_n() returns
+// once it has at least one value, and takes as many as are available, up to
+// n. Each resume of a waiting operation can move up to a whole buffer of
+// values, so a batch costs a few resumes rather than one or two per value.
+//
+// Operations are "yield from" targets, built in place in the lambda's frame
+// from the object returned here. Values are read from, and written to, the
+// given arrays while the operation is waiting, so the arrays must stay where
+// they are until it completes. Waiting operations are served in the order
+// they started.
+
+template <class T, std::size_t Capacity = 64>
+class resumable_channel
+{
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+      "channel capacity must be a power of two");
+
+public:
+  class waiter;
+
+  struct waiter_init
+  {
+    typedef waiter generator_type;
+    resumable_channel* channel_;
+    const T* in_;
+    T* out_;
+    std::size_t n_;
+    std::size_t* count_;
+  };
+
+  class waiter
+  {
+  public:
+    waiter() {}
+    waiter(const waiter&) = delete;
+    waiter(waiter&&) = delete;
+    waiter& operator=(const waiter&) = delete;
+    waiter& operator=(waiter&&) = delete;
+
+    void construct(waiter_init&& w)
+    {
+      in_ = w.in_;
+      out_ = w.out_;
+      remaining_ = w.n_;
+      count_ = w.count_;
+      if (in_)
+        w.channel_->push_some(*this);
+      else
+        w.channel_->pull_some(*this);
+    }
+
+    void destroy()
+    {
+      if (channel_)
+        channel_->remove(*this);
+    }
+
+    // The transfer is made by whichever operation on the other side finds
+    // this one waiting, so there is nothing to do here.
+    void operator()()
+    {
+    }
+
+    bool is_terminal() const noexcept
+    {
+      return channel_ == nullptr;
+    }
+
+#if __RESUMABLE_RTTI
+    const std::type_info& wanted_type() const noexcept
+    {
+      return typeid(void);
+    }
+#endif // __RESUMABLE_RTTI
+
+    void* wanted() noexcept
+    {
+      return nullptr;
+    }
+
+    const void* wanted() const noexcept
+    {
+      return nullptr;
+    }
+
+  private:
+    friend class resumable_channel;
+
+    const T* in_ = nullptr; // non-null for a push
+    T* out_ = nullptr;
+    std::size_t remaining_ = 0;
+    std::size_t* count_ = nullptr;
+    std::size_t pulled_ = 0;
+    resumable_channel* channel_ = nullptr; // non-null while waiting
+    waiter* next_ = nullptr;
+    waiter* prev_ = nullptr;
+  };
+
+  resumable_channel() noexcept
+  {
+  }
+
+  resumable_channel(const resumable_channel&) = delete;
+  resumable_channel& operator=(const resumable_channel&) = delete;
+
+  // Operations must not be left waiting on a channel that is destroyed.
+  ~resumable_channel()
+  {
+    for (; head_ != tail_; ++head_)
+      at(head_)->~T();
+  }
+
+  waiter_init push(const T* value) noexcept
+  {
+    return { this, value, nullptr, 1, nullptr };
+  }
+
+  waiter_init pull(T* value) noexcept
+  {
+    return { this, nullptr, value, 1, nullptr };
+  }
+
+  waiter_init push_n(const T* values, std::size_t n) noexcept
+  {
+    return { this, values, nullptr, n, nullptr };
+  }
+
+  // Stores the number of values pulled in *count, if count is not null.
+  waiter_init pull_n(T* values, std::size_t n, std::size_t* count) noexcept
+  {
+    return { this, nullptr, values, n, count };
+  }
+
+  std::size_t size() const noexcept
+  {
+    return tail_ - head_;
+  }
+
+  static constexpr std::size_t capacity() noexcept
+  {
+    return Capacity;
+  }
+
+  bool empty() const noexcept
+  {
+    return head_ == tail_;
+  }
+
+  bool full() const noexcept
+  {
+    return size() == Capacity;
+  }
+
+private:
+  typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type slot;
+
+  T* at(std::size_t i) noexcept
+  {
+    return reinterpret_cast<T*>(&slots_[i & (Capacity - 1)]);
+  }
+
+  // Copies up to n values into the buffer. Returns how many fitted.
+  std::size_t put(const T* in, std::size_t n)
+  {
+    std::size_t k = Capacity - size();
+    if (k > n)
+      k = n;
+    for (std::size_t i = 0; i < k; ++i)
+    {
+      new (at(tail_)) T(in[i]);
+      ++tail_;
+    }
+    return k;
+  }
+
+  // Moves up to n values out of the buffer. Returns how many there were.
+  std::size_t take(T* out, std::size_t n)
+  {
+    std::size_t k = size();
+    if (k > n)
+      k = n;
+    for (std::size_t i = 0; i < k; ++i)
+    {
+      T* p = at(head_);
+      out[i] = std::move(*p);
+      p->~T();
+      ++head_;
+    }
+    return k;
+  }
+
+  void push_some(waiter& w)
+  {
+    // Pullers only wait while the buffer is empty, so they are given values
+    // directly, ahead of the buffer.
+    while (w.remaining_ && empty() && first_ && !first_->in_)
+    {
+      waiter& p = *first_;
+      std::size_t k = p.remaining_ < w.remaining_ ? p.remaining_ : w.remaining_;
+      for (std::size_t i = 0; i < k; ++i)
+        p.out_[i] = w.in_[i];
+      w.in_ += k;
+      w.remaining_ -= k;
+      p.pulled_ = k;
+      finish(p);
+    }
+
+    std::size_t k = put(w.in_, w.remaining_);
+    w.in_ += k;
+    w.remaining_ -= k;
+
+    if (w.remaining_)
+      insert(w);
+  }
+
+  void pull_some(waiter& w)
+  {
+    while (w.remaining_)
+    {
+      std::size_t k = take(w.out_, w.remaining_);
+      w.out_ += k;
+      w.remaining_ -= k;
+      w.pulled_ += k;
+
+      // Pushers only wait while the buffer is full, so refilling it from
+      // them keeps the values in order. The waiters are either all pushers
+      // or all pullers.
+      while (first_ && first_->in_ && !full())
+      {
+        waiter& p = *first_;
+        std::size_t n = put(p.in_, p.remaining_);
+        p.in_ += n;
+        p.remaining_ -= n;
+        if (!p.remaining_)
+          finish(p);
+      }
+
+      if (empty())
+        break;
+    }
+
+    if (w.pulled_)
+    {
+      if (w.count_)
+        *w.count_ = w.pulled_;
+    }
+    else
+    {
+      insert(w);
+    }
+  }
+
+  // Completes a waiting operation, which its lambda will see the next time
+  // it is resumed.
+  void finish(waiter& w) noexcept
+  {
+    if (w.count_)
+      *w.count_ = w.pulled_;
+    remove(w);
+  }
+
+  void insert(waiter& w) noexcept
+  {
+    w.channel_ = this;
+    w.prev_ = last_;
+    w.next_ = nullptr;
+    if (last_)
+      last_->next_ = &w;
+    else
+      first_ = &w;
+    last_ = &w;
+  }
+
+  void remove(waiter& w) noexcept
+  {
+    if (w.prev_)
+      w.prev_->next_ = w.next_;
+    else
+      first_ = w.next_;
+    if (w.next_)
+      w.next_->prev_ = w.prev_;
+    else
+      last_ = w.prev_;
+    w.next_ = w.prev_ = nullptr;
+    w.channel_ = nullptr;
+  }
+
+  slot slots_[Capacity];
+  std::size_t head_ = 0;
+  std::size_t tail_ = 0;
+  waiter* first_ = nullptr;
+  waiter* last_ = nullptr;
+};
+
+#endif // RESUMABLE_CHANNEL_HPP
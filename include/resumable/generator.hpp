@@ -0,0 +1,380 @@
+#ifndef RESUMABLE_GENERATOR_HPP
+#define RESUMABLE_GENERATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <resumable/arena.hpp>
+
+// A type-erased, move-only generator yielding values of type T.
+//
+// Frames of up to N bytes are stored inside the generator itself. Larger
+// frames come from the free store, or from the resumable_arena the generator
+// was constructed with, if any. A recursive generator can hand its arena on
+// to the sub-generators it delegates to, so that they are allocated and freed
+// as a stack:
+//
+//   resumable_generator<int> flatten(resumable_arena& a, node& n)
+//   {
+//     return resumable_generator<int>(a, [&]() resumable -> int {
+//       if (n.left) yield from flatten(a, *n.left);
+//       ...
+//     });
+//   }
+//
+// Frames aligned more strictly than std::max_align_t always come from the
+// free store.
+//
+// The resume function is held inline, and the terminal flag is cached after
+// every step, so producing a value costs a single indirect call when the
+// generator is not delegating. Everything
+// else goes through a per-type table of function pointers.
+//
+// When the wrapped lambda is delegating to another generator of the same type
+// through "yield from", the innermost one is resumed directly.
+
+template <class T, std::size_t N = 8 * sizeof(void*)>
+class resumable_generator
+{
+public:
+  typedef T result_type;
+
+  resumable_generator() noexcept
+  {
+  }
+
+  resumable_generator(decltype(nullptr)) noexcept
+  {
+  }
+
+  template <class G, class = typename std::enable_if<
+    !std::is_same<typename std::decay<G>::type, resumable_generator>::value>::type>
+  resumable_generator(G&& g)
+  {
+    typedef typename std::decay<G>::type lambda;
+    emplace<lambda>(std::forward<G>(g));
+    terminal_ = ::is_terminal(*static_cast<lambda*>(frame_));
+  }
+
+  // Takes a frame too large for the buffer from the arena, which must
+  // outlive the generator and any clone of it.
+  template <class G>
+  resumable_generator(resumable_arena& a, G&& g)
+    : arena_(&a)
+  {
+    typedef typename std::decay<G>::type lambda;
+    emplace<lambda>(std::forward<G>(g));
+    terminal_ = ::is_terminal(*static_cast<lambda*>(frame_));
+  }
+
+  resumable_generator(resumable_generator&& other)
+  {
+    take(other);
+  }
+
+  resumable_generator& operator=(resumable_generator&& other)
+  {
+    if (this != &other)
+    {
+      destroy();
+      take(other);
+    }
+    return *this;
+  }
+
+  resumable_generator(const resumable_generator&) = delete;
+  resumable_generator& operator=(const resumable_generator&) = delete;
+
+  ~resumable_generator()
+  {
+    destroy();
+  }
+
+  // Returns an independent copy of the generator in its current state. Throws
+  // std::logic_error if the wrapped lambda cannot be copied.
+  resumable_generator clone() const
+  {
+    resumable_generator g;
+    g.arena_ = arena_;
+    if (ops_)
+    {
+      if (!ops_->clone)
+        throw std::logic_error("resumable_generator: frame is not copyable");
+      ops_->clone(*this, g);
+    }
+    return g;
+  }
+
+  T operator()()
+  {
+    return resume();
+  }
+
+  // While delegating, the frame may finish along with the generator it
+  // delegates to through "return from", so the frame is asked directly.
+  bool is_terminal() const noexcept
+  {
+    return delegating_ ? done() : terminal_;
+  }
+
+  void* wanted() noexcept
+  {
+    return ops_ ? ops_->wanted(frame_, resumable_type_id()) : nullptr;
+  }
+
+  void* wanted(resumable_type_id id) noexcept
+  {
+    return ops_ ? ops_->wanted(frame_, id) : nullptr;
+  }
+
+private:
+  struct ops_table
+  {
+    void (*destroy)(resumable_generator&) noexcept;
+    void (*move)(resumable_generator&, resumable_generator&);
+    void (*clone)(const resumable_generator&, resumable_generator&);
+    bool (*is_terminal)(const void*) noexcept;
+    resumable_generator* (*delegate)(void*) noexcept;
+    void* (*wanted)(void*, resumable_type_id) noexcept;
+  };
+
+  template <class G>
+  struct fits : std::integral_constant<bool,
+    sizeof(G) <= N && alignof(G) <= alignof(std::max_align_t)> {};
+
+  template <class G>
+  struct ops
+  {
+    // Refreshes the cached flags once the resumed frame has produced its
+    // value, without having to hold that value in a temporary.
+    struct step
+    {
+      resumable_generator& self;
+      G& g;
+
+      ~step()
+      {
+        self.terminal_ = ::is_terminal(g);
+        self.delegating_ = ::delegate<resumable_generator>(g) != nullptr;
+      }
+    };
+
+    static T invoke(resumable_generator& self)
+    {
+      G& g = *static_cast<G*>(self.frame_);
+      step s = { self, g };
+      return g();
+    }
+
+    static void destroy(resumable_generator& self) noexcept
+    {
+      G* g = static_cast<G*>(self.frame_);
+      g->~G();
+      if (!fits<G>::value)
+        self.deallocate_storage(g, alignof(G));
+    }
+
+    static void move(resumable_generator& src, resumable_generator& dst)
+    {
+      move(src, dst, fits<G>());
+    }
+
+    static void move(resumable_generator& src, resumable_generator& dst, std::true_type)
+    {
+      G* g = static_cast<G*>(src.frame_);
+      dst.frame_ = dst.allocate<G>(std::true_type(), std::move(*g));
+      g->~G();
+    }
+
+    static void move(resumable_generator& src, resumable_generator& dst, std::false_type)
+    {
+      dst.frame_ = src.frame_;
+    }
+
+    static void clone(const resumable_generator& src, resumable_generator& dst)
+    {
+      dst.emplace<G>(*static_cast<const G*>(src.frame_));
+      dst.terminal_ = src.terminal_;
+      dst.delegating_ = src.delegating_;
+    }
+
+    static bool is_terminal(const void* frame) noexcept
+    {
+      return ::is_terminal(*static_cast<const G*>(frame));
+    }
+
+    static resumable_generator* delegate(void* frame) noexcept
+    {
+      return ::delegate<resumable_generator>(*static_cast<G*>(frame));
+    }
+
+    static void* wanted(void* frame, resumable_type_id id) noexcept
+    {
+      G& g = *static_cast<G*>(frame);
+      return id ? ::wanted(g, id) : ::wanted(g);
+    }
+
+    static constexpr void (*clone_fn(std::true_type))(const resumable_generator&, resumable_generator&)
+    {
+      return &clone;
+    }
+
+    static constexpr void (*clone_fn(std::false_type))(const resumable_generator&, resumable_generator&)
+    {
+      return nullptr;
+    }
+
+    static const ops_table* table() noexcept
+    {
+      static const ops_table t =
+      {
+        &destroy, &move, clone_fn(std::is_copy_constructible<G>()),
+        &is_terminal, &delegate, &wanted
+      };
+      return &t;
+    }
+  };
+
+  template <class G, class... Args>
+  void emplace(Args&&... args)
+  {
+    frame_ = allocate<G>(fits<G>(), std::forward<Args>(args)...);
+    ops_ = ops<G>::table();
+    invoke_ = &ops<G>::invoke;
+  }
+
+  template <class G, class... Args>
+  G* allocate(std::true_type, Args&&... args)
+  {
+    return new (buffer_) G(std::forward<Args>(args)...);
+  }
+
+  template <class G, class... Args>
+  G* allocate(std::false_type, Args&&... args)
+  {
+    void* p = allocate_storage(sizeof(G), alignof(G));
+    try
+    {
+      return new (p) G(std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+      deallocate_storage(p, alignof(G));
+      throw;
+    }
+  }
+
+  // An over-aligned frame is placed far enough into a larger block for the
+  // start of the block to be stored just before it.
+  void* allocate_storage(std::size_t size, std::size_t align)
+  {
+    if (align <= alignof(std::max_align_t))
+      return arena_ ? arena_->allocate(size) : ::operator new(size);
+    char* raw = static_cast<char*>(::operator new(size + align));
+    char* p = raw + align - reinterpret_cast<std::uintptr_t>(raw) % align;
+    reinterpret_cast<void**>(p)[-1] = raw;
+    return p;
+  }
+
+  void deallocate_storage(void* p, std::size_t align) noexcept
+  {
+    if (align > alignof(std::max_align_t))
+      ::operator delete(static_cast<void**>(p)[-1]);
+    else if (arena_)
+      arena_->deallocate(p);
+    else
+      ::operator delete(p);
+  }
+
+  void take(resumable_generator& other)
+  {
+    arena_ = other.arena_;
+    if (other.ops_)
+    {
+      other.ops_->move(other, *this);
+      ops_ = other.ops_;
+      invoke_ = other.invoke_;
+      terminal_ = other.terminal_;
+      delegating_ = other.delegating_;
+      other.ops_ = nullptr;
+      other.invoke_ = nullptr;
+      other.frame_ = nullptr;
+      other.terminal_ = true;
+      other.delegating_ = false;
+      other.active_ = nullptr;
+    }
+  }
+
+  void destroy() noexcept
+  {
+    if (ops_)
+    {
+      ops_->destroy(*this);
+      ops_ = nullptr;
+      invoke_ = nullptr;
+      frame_ = nullptr;
+      terminal_ = true;
+      delegating_ = false;
+      active_ = nullptr;
+    }
+  }
+
+  bool done() const noexcept
+  {
+    return !ops_ || ops_->is_terminal(frame_);
+  }
+
+  // Follows the chain of "yield from" delegation down from g to the innermost
+  // generator that can make progress. The generators passed on the way have
+  // not been resumed through their own operator(), so their cached state is
+  // brought up to date before their frames can look at it again.
+  resumable_generator* descend(resumable_generator* g) noexcept
+  {
+    for (;;)
+    {
+      resumable_generator* d = g->ops_ ? g->ops_->delegate(g->frame_) : nullptr;
+      if (!d)
+        return g;
+      d->active_ = nullptr;
+      if (d->done())
+      {
+        d->terminal_ = true;
+        d->delegating_ = false;
+        return g;
+      }
+      g = d;
+    }
+  }
+
+  // The generator last found to be innermost stays valid until it terminates,
+  // as none of the frames above it are resumed in the meantime. Only then is
+  // the chain walked again from the top.
+  T resume()
+  {
+    if (!delegating_)
+      return invoke_(*this);
+
+    resumable_generator* g = active_;
+    if (!g || g->terminal_)
+      g = descend(this);
+    else if (g->delegating_)
+      g = descend(g);
+    active_ = g;
+
+    return g->invoke_(*g);
+  }
+
+  resumable_arena* arena_ = nullptr;
+  const ops_table* ops_ = nullptr;
+  T (*invoke_)(resumable_generator&) = nullptr;
+  void* frame_ = nullptr;
+  resumable_generator* active_ = nullptr;
+  bool terminal_ = true;
+  bool delegating_ = false;
+  alignas(std::max_align_t) unsigned char buffer_[N];
+};
+
+#endif // RESUMABLE_GENERATOR_HPP
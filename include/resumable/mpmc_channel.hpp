@@ -0,0 +1,375 @@
+#ifndef RESUMABLE_MPMC_CHANNEL_HPP
+#define RESUMABLE_MPMC_CHANNEL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <resumable/scheduler.hpp>
+
+// A bounded channel that resumable lambdas on different threads can push to
+// and pull from at the same time.
+//
+// Values go through a lock-free ring of Capacity cells, which must be a
+// power of two, in which producers and consumers each claim a position with
+// a single compare-and-swap. A push into a ring with room, or a pull from a
+// ring that has values, takes no lock and does not suspend.
+//
+// Only an operation that has to wait takes the channel's lock, to join a
+// queue of waiting pushers or pullers. An operation on the other side that
+// finds waiters takes the lock to complete as many of them as it can, in the
+// order they started, and then wakes their tasks by posting them back to
+// their own schedulers through the resumable_waker they were given:
+//
+//   auto consumer = make_task([&, v = int(0)]() resumable
+//     {
+//       for (;;)
+//       {
+//         yield from c.pull(&v, resumable_waker(sched, lambda_ref(lambda_this)));
+//         use(v);
+//       }
+//     });
+//
+// The scheduler must allow a task to be posted from another thread while it
+// is still running, as resumable_stealing_scheduler and
+// resumable_sharded_scheduler do. A waiter is registered before its task has
+// suspended, so it can be completed, and its task posted, before the resume
+// that started it has returned.
+//
+// As with resumable_channel, a pushed value is read from, and a pulled value
+// written to, the given pointer while the operation waits.
+
+template <class T, std::size_t Capacity = 64>
+class resumable_mpmc_channel
+{
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+      "channel capacity must be a power of two");
+
+public:
+  class waiter;
+
+  struct waiter_init
+  {
+    typedef waiter generator_type;
+    resumable_mpmc_channel* channel_;
+    const T* in_;
+    T* out_;
+    resumable_waker waker_;
+  };
+
+  class waiter
+  {
+  public:
+    waiter() {}
+    waiter(const waiter&) = delete;
+    waiter(waiter&&) = delete;
+    waiter& operator=(const waiter&) = delete;
+    waiter& operator=(waiter&&) = delete;
+
+    void construct(waiter_init&& w)
+    {
+      channel_ = w.channel_;
+      in_ = w.in_;
+      out_ = w.out_;
+      waker_ = &w.waker_;
+      if (in_)
+        channel_->push_or_wait(*this);
+      else
+        channel_->pull_or_wait(*this);
+      waker_ = nullptr;
+    }
+
+    void destroy()
+    {
+      if (!done_.load(std::memory_order_acquire))
+        channel_->cancel(*this);
+    }
+
+    // The transfer is made by whichever operation on the other side finds
+    // this one waiting, so there is nothing to do here.
+    void operator()()
+    {
+    }
+
+    bool is_terminal() const noexcept
+    {
+      return done_.load(std::memory_order_acquire);
+    }
+
+#if __RESUMABLE_RTTI
+    const std::type_info& wanted_type() const noexcept
+    {
+      return typeid(void);
+    }
+#endif // __RESUMABLE_RTTI
+
+    void* wanted() noexcept
+    {
+      return nullptr;
+    }
+
+    const void* wanted() const noexcept
+    {
+      return nullptr;
+    }
+
+  private:
+    friend class resumable_mpmc_channel;
+
+    resumable_mpmc_channel* channel_ = nullptr;
+    const T* in_ = nullptr; // non-null for a push
+    T* out_ = nullptr;
+
+    // The waker passed in, while construct() runs, and a copy of it once the
+    // operation waits.
+    const resumable_waker* waker_ = nullptr;
+    typename std::aligned_storage<sizeof(resumable_waker),
+      alignof(resumable_waker)>::type saved_;
+
+    std::atomic<bool> done_{false};
+    waiter* next_ = nullptr;
+    waiter* prev_ = nullptr;
+  };
+
+  resumable_mpmc_channel() noexcept
+  {
+    for (std::size_t i = 0; i < Capacity; ++i)
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  resumable_mpmc_channel(const resumable_mpmc_channel&) = delete;
+  resumable_mpmc_channel& operator=(const resumable_mpmc_channel&) = delete;
+
+  // Operations must not be left waiting on a channel that is destroyed.
+  ~resumable_mpmc_channel()
+  {
+    std::size_t end = push_pos_.load(std::memory_order_relaxed);
+    for (std::size_t pos = pull_pos_.load(std::memory_order_relaxed); pos != end; ++pos)
+      reinterpret_cast<T*>(&cells_[pos & (Capacity - 1)].value)->~T();
+  }
+
+  waiter_init push(const T* value, resumable_waker waker) noexcept
+  {
+    return { this, value, nullptr, waker };
+  }
+
+  waiter_init pull(T* value, resumable_waker waker) noexcept
+  {
+    return { this, nullptr, value, waker };
+  }
+
+  static constexpr std::size_t capacity() noexcept
+  {
+    return Capacity;
+  }
+
+private:
+  struct cell
+  {
+    std::atomic<std::size_t> seq;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type value;
+  };
+
+  struct queue
+  {
+    waiter* first = nullptr;
+    waiter* last = nullptr;
+    std::atomic<bool> waiting{false};
+  };
+
+  // The ring is Dmitry Vyukov's bounded MPMC queue. Each cell's sequence
+  // number says whether it is free for the push at its position, or holds
+  // the value for the pull at its position.
+  bool enqueue(const T& value)
+  {
+    std::size_t pos = push_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      cell& c = cells_[pos & (Capacity - 1)];
+      std::size_t seq = c.seq.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0)
+      {
+        if (push_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          new (&c.value) T(value);
+          c.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = push_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool dequeue(T& value)
+  {
+    std::size_t pos = pull_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      cell& c = cells_[pos & (Capacity - 1)];
+      std::size_t seq = c.seq.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0)
+      {
+        if (pull_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          T* p = reinterpret_cast<T*>(&c.value);
+          value = std::move(*p);
+          p->~T();
+          c.seq.store(pos + Capacity, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = pull_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // A waiter joins its queue and then tries once more to complete, while an
+  // operation on the other side makes its transfer and then looks for
+  // waiters. The fences make sure that at least one of them sees the other.
+  void push_or_wait(waiter& w)
+  {
+    if (enqueue(*w.in_))
+    {
+      complete(w);
+      serve(pullers_);
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    wait(pushers_, w);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    serve(pushers_, lock, &w);
+  }
+
+  void pull_or_wait(waiter& w)
+  {
+    if (dequeue(*w.out_))
+    {
+      complete(w);
+      serve(pushers_);
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    wait(pullers_, w);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    serve(pullers_, lock, &w);
+  }
+
+  void serve(queue& q)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!q.waiting.load(std::memory_order_relaxed))
+      return;
+    std::unique_lock<std::mutex> lock(mutex_);
+    serve(q, lock, nullptr);
+  }
+
+  // Completes the waiters in q that the ring now has room or values for, in
+  // order, and posts their tasks once the lock has been released. A waiter
+  // may be destroyed as soon as it is marked done, so its waker is copied
+  // out first. The waiter of the calling task, self, is completed without
+  // being woken.
+  void serve(queue& q, std::unique_lock<std::mutex>& lock, waiter* self)
+  {
+    static const std::size_t batch = 16;
+    bool more = true;
+    while (more)
+    {
+      typename std::aligned_storage<sizeof(resumable_waker),
+        alignof(resumable_waker)>::type wakers[batch];
+      std::size_t n = 0;
+      more = false;
+      while (waiter* w = q.first)
+      {
+        if (w->in_ ? !enqueue(*w->in_) : !dequeue(*w->out_))
+          break;
+        unlink(q, *w);
+        if (w != self)
+          new (&wakers[n++]) resumable_waker(*saved(*w));
+        complete(*w);
+        if (n == batch)
+        {
+          more = true;
+          break;
+        }
+      }
+      lock.unlock();
+      for (std::size_t i = 0; i < n; ++i)
+        (*reinterpret_cast<resumable_waker*>(&wakers[i]))();
+      if (more)
+        lock.lock();
+    }
+  }
+
+  static resumable_waker* saved(waiter& w) noexcept
+  {
+    return reinterpret_cast<resumable_waker*>(&w.saved_);
+  }
+
+  void complete(waiter& w) noexcept
+  {
+    w.done_.store(true, std::memory_order_release);
+  }
+
+  void wait(queue& q, waiter& w) noexcept
+  {
+    new (&w.saved_) resumable_waker(*w.waker_);
+    w.prev_ = q.last;
+    w.next_ = nullptr;
+    if (q.last)
+      q.last->next_ = &w;
+    else
+      q.first = &w;
+    q.last = &w;
+    q.waiting.store(true, std::memory_order_relaxed);
+  }
+
+  void unlink(queue& q, waiter& w) noexcept
+  {
+    if (w.prev_)
+      w.prev_->next_ = w.next_;
+    else
+      q.first = w.next_;
+    if (w.next_)
+      w.next_->prev_ = w.prev_;
+    else
+      q.last = w.prev_;
+    w.next_ = w.prev_ = nullptr;
+    if (!q.first)
+      q.waiting.store(false, std::memory_order_relaxed);
+  }
+
+  void cancel(waiter& w)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!w.done_.load(std::memory_order_relaxed))
+      unlink(w.in_ ? pushers_ : pullers_, w);
+  }
+
+  cell cells_[Capacity];
+  std::atomic<std::size_t> push_pos_{0};
+  char pad1_[64];
+  std::atomic<std::size_t> pull_pos_{0};
+  char pad2_[64];
+  std::mutex mutex_;
+  queue pushers_;
+  queue pullers_;
+};
+
+#endif // RESUMABLE_MPMC_CHANNEL_HPP
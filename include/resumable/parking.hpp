@@ -0,0 +1,110 @@
+#ifndef RESUMABLE_PARKING_HPP
+#define RESUMABLE_PARKING_HPP
+
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#if defined(__linux__)
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+// Lets scheduler threads sleep while they have nothing to do.
+//
+// A thread calls prepare() before it looks for work one last time, and then
+// either cancel() if it found some, or wait() with the value prepare()
+// returned. A thread that makes work available calls notify_one() afterwards.
+// Either the sleeper's last look finds the work, or the notification finds
+// the sleeper, so no wake-up is lost. notify_one() costs a fence and a load
+// when nobody is asleep.
+//
+// Sleeping uses a futex on Linux and a condition variable elsewhere.
+
+class resumable_parking
+{
+public:
+  resumable_parking() noexcept
+  {
+  }
+
+  resumable_parking(const resumable_parking&) = delete;
+  resumable_parking& operator=(const resumable_parking&) = delete;
+
+  std::uint32_t prepare() noexcept
+  {
+    std::uint32_t e = epoch_.load(std::memory_order_seq_cst);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    return e;
+  }
+
+  void cancel() noexcept
+  {
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Returns when notified after the matching prepare(), and possibly
+  // earlier.
+  void wait(std::uint32_t e)
+  {
+    park(e);
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void notify_one()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) > 0)
+    {
+      epoch_.fetch_add(1, std::memory_order_seq_cst);
+      unpark(1);
+    }
+  }
+
+  void notify_all()
+  {
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    unpark(INT_MAX);
+  }
+
+private:
+#if defined(__linux__)
+  void park(std::uint32_t e)
+  {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&epoch_),
+        FUTEX_WAIT_PRIVATE, e, nullptr, nullptr, 0);
+  }
+
+  void unpark(int n)
+  {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&epoch_),
+        FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+  }
+#else
+  void park(std::uint32_t e)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this, e] { return epoch_.load(std::memory_order_seq_cst) != e; });
+  }
+
+  void unpark(int n)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (n == 1)
+      cv_.notify_one();
+    else
+      cv_.notify_all();
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+#endif
+
+  std::atomic<std::uint32_t> epoch_{0};
+  std::atomic<int> sleepers_{0};
+};
+
+#endif // RESUMABLE_PARKING_HPP
@@ -0,0 +1,272 @@
+#ifndef RESUMABLE_POOL_HPP
+#define RESUMABLE_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Recycles the storage of resumable lambdas of type F, for code that creates
+// and destroys them at a high rate.
+//
+// Each thread keeps a cache of free slots. When a cache grows too large, a
+// batch of slots is pushed onto a global list with a single compare-and-swap.
+// A thread whose cache is empty takes the whole global list in one exchange,
+// and only goes to the free store when that is empty too. Since nothing is
+// ever popped from the global list one slot at a time, it is not exposed to
+// the ABA problem.
+//
+// Slots are allocated in blocks and are kept for the life of the program, so
+// the pool is shared by every resumable_pool<F> object.
+//
+//   typedef decltype(initializer(countdown(0))) init_type;
+//   auto f = resumable_pool<init_type>::make(initializer(countdown(4)));
+//   while (!is_terminal(f))
+//     use(f());
+//
+// The frame goes back to the pool as soon as a resume leaves it terminal, or
+// when the handle is destroyed, whichever comes first. A lambda that returns
+// a reference may be returning one into its own frame, so its frame is kept
+// until the handle is destroyed.
+
+template <class F>
+class resumable_pool
+{
+public:
+  typedef lambda_t<F> frame_type;
+  typedef decltype(std::declval<frame_type&>()()) result_type;
+
+  class handle
+  {
+  public:
+    handle() noexcept
+    {
+    }
+
+    handle(handle&& other) noexcept
+      : frame_(other.frame_)
+    {
+      other.frame_ = nullptr;
+    }
+
+    handle& operator=(handle&& other) noexcept
+    {
+      if (this != &other)
+      {
+        recycle();
+        frame_ = other.frame_;
+        other.frame_ = nullptr;
+      }
+      return *this;
+    }
+
+    handle(const handle&) = delete;
+    handle& operator=(const handle&) = delete;
+
+    ~handle()
+    {
+      recycle();
+    }
+
+    frame_type* get() const noexcept
+    {
+      return frame_;
+    }
+
+    frame_type& operator*() const noexcept
+    {
+      return *frame_;
+    }
+
+    frame_type* operator->() const noexcept
+    {
+      return frame_;
+    }
+
+    bool is_terminal() const noexcept
+    {
+      return !frame_ || ::is_terminal(*frame_);
+    }
+
+    result_type operator()()
+    {
+      finish f = { *this };
+      return (*frame_)();
+    }
+
+  private:
+    friend class resumable_pool;
+
+    explicit handle(frame_type* f) noexcept
+      : frame_(f)
+    {
+    }
+
+    // Runs after the result of a resume has been constructed.
+    struct finish
+    {
+      handle& h;
+
+      ~finish()
+      {
+        if (!std::is_reference<result_type>::value && ::is_terminal(*h.frame_))
+          h.recycle();
+      }
+    };
+
+    void recycle() noexcept
+    {
+      if (frame_)
+      {
+        destroy_frame(frame_);
+        deallocate(frame_);
+        frame_ = nullptr;
+      }
+    }
+
+    frame_type* frame_ = nullptr;
+  };
+
+  // Constructs a frame from either a lambda or the result of initializer().
+  template <class T>
+  static handle make(T&& t)
+  {
+    void* p = allocate();
+    try
+    {
+      frame_type* f = emplace_into(p, static_cast<T&&>(t));
+      return handle(f);
+    }
+    catch (...)
+    {
+      deallocate(p);
+      throw;
+    }
+  }
+
+  // The number of slots obtained from the free store so far.
+  static std::size_t capacity() noexcept
+  {
+    return allocated().load(std::memory_order_relaxed);
+  }
+
+private:
+  static const std::size_t block_slots = 64;
+  static const std::size_t batch = 32;
+
+  union slot
+  {
+    slot* next;
+    typename std::aligned_storage<
+      resumable_frame_traits<F>::size,
+      resumable_frame_traits<F>::alignment>::type frame;
+  };
+
+  struct cache
+  {
+    slot* head = nullptr;
+    std::size_t count = 0;
+
+    ~cache()
+    {
+      if (head)
+      {
+        slot* last = head;
+        while (last->next)
+          last = last->next;
+        push(head, last);
+      }
+    }
+  };
+
+  static cache& local() noexcept
+  {
+    static thread_local cache c;
+    return c;
+  }
+
+  static std::atomic<slot*>& shared() noexcept
+  {
+    static std::atomic<slot*> head(nullptr);
+    return head;
+  }
+
+  static std::atomic<std::size_t>& allocated() noexcept
+  {
+    static std::atomic<std::size_t> n(0);
+    return n;
+  }
+
+  static void push(slot* first, slot* last) noexcept
+  {
+    std::atomic<slot*>& head = shared();
+    slot* top = head.load(std::memory_order_relaxed);
+    do
+      last->next = top;
+    while (!head.compare_exchange_weak(top, first,
+          std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  // Blocks are never freed, so a block of slots aligned more strictly than
+  // the free store guarantees is allocated with room to spare and aligned
+  // by hand.
+  static slot* new_block()
+  {
+    const std::size_t align = alignof(slot);
+    const std::size_t extra = align > alignof(std::max_align_t) ? align : 0;
+    char* p = static_cast<char*>(::operator new(sizeof(slot) * block_slots + extra));
+    if (extra)
+      p += align - reinterpret_cast<std::uintptr_t>(p) % align;
+    return reinterpret_cast<slot*>(p);
+  }
+
+  static void* allocate()
+  {
+    cache& c = local();
+    if (!c.head)
+    {
+      c.head = shared().exchange(nullptr, std::memory_order_acquire);
+      for (slot* s = c.head; s; s = s->next)
+        ++c.count;
+    }
+
+    if (!c.head)
+    {
+      slot* block = new_block();
+      for (std::size_t i = 0; i < block_slots - 1; ++i)
+        block[i].next = &block[i + 1];
+      block[block_slots - 1].next = nullptr;
+      c.head = block;
+      c.count = block_slots;
+      allocated().fetch_add(block_slots, std::memory_order_relaxed);
+    }
+
+    slot* s = c.head;
+    c.head = s->next;
+    --c.count;
+    return s;
+  }
+
+  static void deallocate(void* p) noexcept
+  {
+    cache& c = local();
+    slot* s = static_cast<slot*>(p);
+    s->next = c.head;
+    c.head = s;
+
+    if (++c.count > 2 * batch)
+    {
+      slot* first = c.head;
+      slot* last = first;
+      for (std::size_t i = 1; i < batch; ++i)
+        last = last->next;
+      c.head = last->next;
+      c.count -= batch;
+      push(first, last);
+    }
+  }
+};
+
+#endif // RESUMABLE_POOL_HPP
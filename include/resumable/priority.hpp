@@ -0,0 +1,268 @@
+#ifndef RESUMABLE_PRIORITY_HPP
+#define RESUMABLE_PRIORITY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <resumable/scheduler.hpp>
+
+// A single-threaded scheduler that runs resumable_task<F> objects by
+// priority class and, within a class, earliest deadline first.
+//
+// Class 0 is the most urgent. Deadlines are plain numbers in whatever unit
+// the caller keeps time in, and tasks with equal deadlines run in the order
+// they were posted. A task posted without a deadline runs after every task
+// in its class that has one.
+//
+//   resumable_priority_scheduler<2> sched;
+//   sched.set_budget(1, 16);
+//   sched.post(ui_task, 0, now + 5);
+//   sched.post(batch_task, 1);
+//   for (;;)
+//   {
+//     poll_input();
+//     sched.tick();
+//   }
+//
+// Each class has its own radix heap. Posting a task and taking the most
+// urgent one cost O(1) amortised, plus a rescan of at most one bucket per
+// distinct deadline. A deadline that has already passed counts as the
+// earliest deadline still queued.
+//
+// A tick resumes the most urgent task, again and again, until nothing is
+// left, the tick's total budget is used up, or every class with tasks has
+// used up its own budget for the tick. Giving batch classes a budget makes a
+// tick return, so that new interactive work can be posted, after a bounded
+// number of batch resumes. Because interactive tasks are always taken first,
+// the delay before one of them runs is then bounded by the length of a tick.
+//
+// As with resumable_scheduler, a task may only be queued once at a time.
+
+template <std::size_t Classes = 4>
+class resumable_priority_scheduler
+{
+  static_assert(Classes > 0 && Classes <= 32, "between 1 and 32 priority classes");
+
+public:
+  typedef std::uint64_t deadline_type;
+
+  static const deadline_type no_deadline = ~deadline_type(0);
+  static const std::size_t unlimited = ~std::size_t(0);
+
+  explicit resumable_priority_scheduler(std::size_t tick_budget = unlimited) noexcept
+    : tick_budget_(tick_budget)
+  {
+    for (std::size_t c = 0; c < Classes; ++c)
+      budget_[c] = unlimited;
+  }
+
+  resumable_priority_scheduler(const resumable_priority_scheduler&) = delete;
+  resumable_priority_scheduler& operator=(const resumable_priority_scheduler&) = delete;
+
+  // The most resumes that tasks of class c get in one tick, which must be at
+  // least 1.
+  void set_budget(std::size_t c, std::size_t n) noexcept
+  {
+    budget_[c] = n;
+  }
+
+  // Queues a task in class c. Returns 0 so that a task can write
+  // "yield sched.post(...)".
+  int post(resumable_hook& h, std::size_t c = Classes - 1,
+      deadline_type deadline = no_deadline) noexcept
+  {
+    queues_[c].push(h, deadline);
+    nonempty_ |= std::uint32_t(1) << c;
+    ++size_;
+    return 0;
+  }
+
+  template <class F>
+  int post(resumable_ref<F> r, std::size_t c = Classes - 1,
+      deadline_type deadline = no_deadline) noexcept
+  {
+    return post(resumable_task<F>::containing(r.get()), c, deadline);
+  }
+
+  bool empty() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  std::size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  // Runs one tick. Returns the number of resumes.
+  std::size_t tick()
+  {
+    std::size_t used[Classes] = {};
+    std::uint32_t exhausted = 0;
+    std::size_t n = 0;
+    while (n < tick_budget_)
+    {
+      std::uint32_t ready = nonempty_ & ~exhausted;
+      if (!ready)
+        break;
+      std::size_t c = lowest_bit(ready);
+      resumable_hook* h = queues_[c].pop();
+      if (queues_[c].empty())
+        nonempty_ &= ~(std::uint32_t(1) << c);
+      --size_;
+      if (++used[c] == budget_[c])
+        exhausted |= std::uint32_t(1) << c;
+      ++n;
+      h->resume();
+    }
+    return n;
+  }
+
+  // Runs ticks until the queue is empty. Returns the number of resumes.
+  std::size_t run()
+  {
+    std::size_t n = 0;
+    while (!empty())
+      n += tick();
+    return n;
+  }
+
+private:
+  static std::size_t lowest_bit(std::uint64_t x) noexcept
+  {
+#if defined(__GNUC__)
+    return static_cast<std::size_t>(__builtin_ctzll(x));
+#else
+    std::size_t i = 0;
+    while (!(x & 1))
+      x >>= 1, ++i;
+    return i;
+#endif
+  }
+
+  static std::size_t highest_bit(std::uint64_t x) noexcept
+  {
+#if defined(__GNUC__)
+    return 63 - static_cast<std::size_t>(__builtin_clzll(x));
+#else
+    std::size_t i = 0;
+    while (x >>= 1)
+      ++i;
+    return i;
+#endif
+  }
+
+  // A monotone radix heap of hooks, keyed by deadline. Bucket 0 holds the
+  // tasks whose deadline equals the last one taken, and bucket i > 0 those
+  // whose deadline first differs from it in bit i - 1. Taking a task from an
+  // empty bucket 0 moves the next non-empty bucket down, so each task is
+  // moved at most once per bit of its deadline. The heap starts again from
+  // 0 whenever it empties.
+  //
+  // Tasks without a deadline wait in a list of their own, which is only
+  // drawn from while the heap is empty.
+  class radix_queue
+  {
+  public:
+    bool empty() const noexcept
+    {
+      return !buckets_[0].first && !nonempty_ && !later_.first;
+    }
+
+    void push(resumable_hook& h, deadline_type key) noexcept
+    {
+      if (key == no_deadline)
+      {
+        append(later_, &h);
+        return;
+      }
+      if (key < last_)
+        key = last_;
+      h.key_ = key;
+      insert(&h);
+    }
+
+    resumable_hook* pop() noexcept
+    {
+      if (!buckets_[0].first)
+      {
+        if (!nonempty_)
+          return take(later_);
+
+        std::size_t i = lowest_bit(nonempty_) + 1;
+        list moved = buckets_[i];
+        buckets_[i] = list();
+        nonempty_ &= ~(std::uint64_t(1) << (i - 1));
+
+        last_ = moved.first->key_;
+        for (resumable_hook* h = moved.first->next_; h; h = h->next_)
+          if (h->key_ < last_)
+            last_ = h->key_;
+
+        for (resumable_hook* h = moved.first; h; )
+        {
+          resumable_hook* next = h->next_;
+          insert(h);
+          h = next;
+        }
+      }
+
+      resumable_hook* h = take(buckets_[0]);
+      if (!buckets_[0].first && !nonempty_)
+        last_ = 0;
+      return h;
+    }
+
+  private:
+    struct list
+    {
+      resumable_hook* first = nullptr;
+      resumable_hook* last = nullptr;
+    };
+
+    std::size_t bucket(deadline_type key) const noexcept
+    {
+      return key == last_ ? 0 : highest_bit(key ^ last_) + 1;
+    }
+
+    void insert(resumable_hook* h) noexcept
+    {
+      std::size_t i = bucket(h->key_);
+      append(buckets_[i], h);
+      if (i > 0)
+        nonempty_ |= std::uint64_t(1) << (i - 1);
+    }
+
+    static void append(list& b, resumable_hook* h) noexcept
+    {
+      h->next_ = nullptr;
+      if (b.last)
+        b.last->next_ = h;
+      else
+        b.first = h;
+      b.last = h;
+    }
+
+    static resumable_hook* take(list& b) noexcept
+    {
+      resumable_hook* h = b.first;
+      b.first = h->next_;
+      if (!b.first)
+        b.last = nullptr;
+      h->next_ = nullptr;
+      return h;
+    }
+
+    list buckets_[65];
+    list later_;
+    std::uint64_t nonempty_ = 0;
+    deadline_type last_ = 0;
+  };
+
+  radix_queue queues_[Classes];
+  std::size_t budget_[Classes];
+  std::size_t tick_budget_;
+  std::size_t size_ = 0;
+  std::uint32_t nonempty_ = 0;
+};
+
+#endif // RESUMABLE_PRIORITY_HPP
@@ -0,0 +1,503 @@
+#ifndef RESUMABLE_RANGE_HPP
+#define RESUMABLE_RANGE_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Input ranges over resumable lambdas, or anything else that can be called
+// and passed to is_terminal().
+//
+//   for (int i : as_range(g))
+//     ...
+//
+// The combinators resumable_map(), resumable_filter(), resumable_take() and
+// resumable_chunk() are applied with "|".
+// Each one wraps its source by value, or by reference when the source is an
+// lvalue, so a whole pipeline is a single object with no type erasure or
+// indirect calls between the stages. Nothing is evaluated until the
+// pipeline is iterated or called.
+//
+//   for (auto v : g | resumable_filter(is_odd) | resumable_map(square)
+//                   | resumable_chunk(16))
+//     ...
+//
+// Every range is itself a generator, with operator() and is_terminal(), so
+// pipelines can also be resumed by hand or fed into anything else in this
+// directory that takes a generator.
+
+template <class G>
+using resumable_value_t = typename std::decay<decltype(std::declval<G&>()())>::type;
+
+// Provides begin() and end() for a Derived class with is_terminal() and
+// operator(). The value under the iterator is held here, so iterators are a
+// single pointer and can be copied freely.
+template <class Derived, class T>
+class resumable_view
+{
+public:
+  typedef T value_type;
+
+  class iterator
+  {
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const T* pointer;
+    typedef const T& reference;
+
+    iterator() noexcept
+    {
+    }
+
+    const T& operator*() const noexcept
+    {
+      return *view_->value();
+    }
+
+    const T* operator->() const noexcept
+    {
+      return view_->value();
+    }
+
+    iterator& operator++()
+    {
+      view_->advance();
+      return *this;
+    }
+
+    struct postfix
+    {
+      T value;
+      const T& operator*() const noexcept { return value; }
+    };
+
+    postfix operator++(int)
+    {
+      postfix p = { std::move(*view_->value()) };
+      view_->advance();
+      return p;
+    }
+
+    friend bool operator==(const iterator& a, const iterator& b) noexcept
+    {
+      return a.at_end() == b.at_end();
+    }
+
+    friend bool operator!=(const iterator& a, const iterator& b) noexcept
+    {
+      return a.at_end() != b.at_end();
+    }
+
+  private:
+    friend class resumable_view;
+
+    explicit iterator(resumable_view* v) noexcept
+      : view_(v)
+    {
+    }
+
+    bool at_end() const noexcept
+    {
+      return !view_ || !view_->engaged_;
+    }
+
+    resumable_view* view_ = nullptr;
+  };
+
+  resumable_view() noexcept
+  {
+  }
+
+  resumable_view(const resumable_view& other)
+  {
+    if (other.engaged_)
+      emplace(*other.value());
+  }
+
+  resumable_view(resumable_view&& other)
+  {
+    if (other.engaged_)
+      emplace(std::move(*other.value()));
+  }
+
+  resumable_view& operator=(const resumable_view&) = delete;
+
+  ~resumable_view()
+  {
+    clear();
+  }
+
+  // Iteration resumes from wherever the underlying generator has got to.
+  iterator begin()
+  {
+    if (!engaged_)
+      advance();
+    return iterator(this);
+  }
+
+  iterator end() noexcept
+  {
+    return iterator();
+  }
+
+private:
+  T* value() noexcept
+  {
+    return reinterpret_cast<T*>(&storage_);
+  }
+
+  const T* value() const noexcept
+  {
+    return reinterpret_cast<const T*>(&storage_);
+  }
+
+  template <class V>
+  void emplace(V&& v)
+  {
+    new (&storage_) T(std::forward<V>(v));
+    engaged_ = true;
+  }
+
+  void clear() noexcept
+  {
+    if (engaged_)
+    {
+      value()->~T();
+      engaged_ = false;
+    }
+  }
+
+  void advance()
+  {
+    clear();
+    Derived& d = static_cast<Derived&>(*this);
+    if (!d.is_terminal())
+      emplace(d());
+  }
+
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
+  bool engaged_ = false;
+};
+
+template <class G>
+class resumable_range :
+  public resumable_view<resumable_range<G>, resumable_value_t<G>>
+{
+public:
+  explicit resumable_range(G&& g)
+    : g_(std::forward<G>(g))
+  {
+  }
+
+  bool is_terminal() const noexcept(noexcept(::is_terminal(std::declval<const G&>())))
+  {
+    return ::is_terminal(g_);
+  }
+
+  resumable_value_t<G> operator()()
+  {
+    return g_();
+  }
+
+private:
+  G g_;
+};
+
+template <class G>
+inline resumable_range<G> as_range(G&& g)
+{
+  return resumable_range<G>(std::forward<G>(g));
+}
+
+// Base class for the objects returned by resumable_map(), resumable_filter(),
+// resumable_take() and resumable_chunk(), which are applied to a generator
+// with operator|.
+struct resumable_combinator
+{
+};
+
+template <class G, class C, class = typename std::enable_if<
+  std::is_base_of<resumable_combinator, typename std::decay<C>::type>::value>::type>
+inline auto operator|(G&& g, C&& c) -> decltype(std::forward<C>(c)(std::forward<G>(g)))
+{
+  return std::forward<C>(c)(std::forward<G>(g));
+}
+
+template <class G, class F>
+class resumable_mapped :
+  public resumable_view<resumable_mapped<G, F>,
+    typename std::decay<decltype(std::declval<F&>()(std::declval<resumable_value_t<G>>()))>::type>
+{
+public:
+  resumable_mapped(G&& g, F f)
+    : g_(std::forward<G>(g)), f_(std::move(f))
+  {
+  }
+
+  bool is_terminal() const noexcept(noexcept(::is_terminal(std::declval<const G&>())))
+  {
+    return ::is_terminal(g_);
+  }
+
+  auto operator()() -> decltype(std::declval<F&>()(std::declval<resumable_value_t<G>>()))
+  {
+    return f_(g_());
+  }
+
+private:
+  G g_;
+  F f_;
+};
+
+template <class G, class P>
+class resumable_filtered :
+  public resumable_view<resumable_filtered<G, P>, resumable_value_t<G>>
+{
+public:
+  typedef resumable_value_t<G> value_type;
+
+  resumable_filtered(G&& g, P p)
+    : source_{std::forward<G>(g)}, p_(std::move(p))
+  {
+  }
+
+  resumable_filtered(const resumable_filtered& other)
+    : resumable_filtered::resumable_view(other), source_(other.source_), p_(other.p_)
+  {
+    if (other.found_)
+      hold(*other.next());
+  }
+
+  resumable_filtered(resumable_filtered&& other)
+    : resumable_filtered::resumable_view(std::move(other)),
+      source_{std::forward<G>(other.source_.g)}, p_(std::move(other.p_))
+  {
+    if (other.found_)
+      hold(std::move(*other.next()));
+  }
+
+  // An element looked up by is_terminal() has already been taken from the
+  // source. If the filter is destroyed before returning it, it is lost, which
+  // matters when the source is an lvalue that outlives the filter.
+  ~resumable_filtered()
+  {
+    drop();
+  }
+
+  // Whether anything is left can only be known by finding the next element
+  // that passes the predicate, so that element is looked up here and held
+  // until the following call. The lookahead only caches what the next call
+  // would return, so the members it touches are mutable.
+  bool is_terminal() const
+  {
+    find();
+    return !found_;
+  }
+
+  value_type operator()()
+  {
+    find();
+    value_type v(std::move(*next()));
+    drop();
+    return v;
+  }
+
+private:
+  const value_type* next() const noexcept
+  {
+    return reinterpret_cast<const value_type*>(&next_);
+  }
+
+  value_type* next() noexcept
+  {
+    return reinterpret_cast<value_type*>(&next_);
+  }
+
+  template <class V>
+  void hold(V&& v) const
+  {
+    new (&next_) value_type(std::forward<V>(v));
+    found_ = true;
+  }
+
+  void drop() noexcept
+  {
+    if (found_)
+    {
+      next()->~value_type();
+      found_ = false;
+    }
+  }
+
+  void find() const
+  {
+    while (!found_ && !::is_terminal(source_.g))
+    {
+      value_type v(source_.g());
+      if (p_(static_cast<const value_type&>(v)))
+        hold(std::move(v));
+    }
+  }
+
+  // G may be a reference, which cannot be declared mutable itself.
+  struct source
+  {
+    G g;
+  };
+
+  mutable source source_;
+  mutable P p_;
+  mutable typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type next_;
+  mutable bool found_ = false;
+};
+
+template <class G>
+class resumable_taken :
+  public resumable_view<resumable_taken<G>, resumable_value_t<G>>
+{
+public:
+  resumable_taken(G&& g, std::size_t n)
+    : g_(std::forward<G>(g)), n_(n)
+  {
+  }
+
+  bool is_terminal() const noexcept(noexcept(::is_terminal(std::declval<const G&>())))
+  {
+    return n_ == 0 || ::is_terminal(g_);
+  }
+
+  resumable_value_t<G> operator()()
+  {
+    --n_;
+    return g_();
+  }
+
+private:
+  G g_;
+  std::size_t n_;
+};
+
+template <class G>
+class resumable_chunked :
+  public resumable_view<resumable_chunked<G>, std::vector<resumable_value_t<G>>>
+{
+public:
+  resumable_chunked(G&& g, std::size_t n)
+    : g_(std::forward<G>(g)), n_(n ? n : 1)
+  {
+  }
+
+  bool is_terminal() const noexcept(noexcept(::is_terminal(std::declval<const G&>())))
+  {
+    return ::is_terminal(g_);
+  }
+
+  // Returns up to n elements. Only the last chunk can be shorter.
+  std::vector<resumable_value_t<G>> operator()()
+  {
+    std::vector<resumable_value_t<G>> v;
+    v.reserve(n_);
+    while (v.size() < n_ && !::is_terminal(g_))
+      v.push_back(g_());
+    return v;
+  }
+
+private:
+  G g_;
+  std::size_t n_;
+};
+
+template <class F>
+struct resumable_map_fn : resumable_combinator
+{
+  explicit resumable_map_fn(F f) : f(std::move(f)) {}
+
+  F f;
+
+  template <class G>
+  resumable_mapped<G, F> operator()(G&& g) &&
+  {
+    return resumable_mapped<G, F>(std::forward<G>(g), std::move(f));
+  }
+
+  template <class G>
+  resumable_mapped<G, F> operator()(G&& g) const &
+  {
+    return resumable_mapped<G, F>(std::forward<G>(g), f);
+  }
+};
+
+template <class P>
+struct resumable_filter_fn : resumable_combinator
+{
+  explicit resumable_filter_fn(P p) : p(std::move(p)) {}
+
+  P p;
+
+  template <class G>
+  resumable_filtered<G, P> operator()(G&& g) &&
+  {
+    return resumable_filtered<G, P>(std::forward<G>(g), std::move(p));
+  }
+
+  template <class G>
+  resumable_filtered<G, P> operator()(G&& g) const &
+  {
+    return resumable_filtered<G, P>(std::forward<G>(g), p);
+  }
+};
+
+struct resumable_take_fn : resumable_combinator
+{
+  explicit resumable_take_fn(std::size_t n) : n(n) {}
+
+  std::size_t n;
+
+  template <class G>
+  resumable_taken<G> operator()(G&& g) const
+  {
+    return resumable_taken<G>(std::forward<G>(g), n);
+  }
+};
+
+struct resumable_chunk_fn : resumable_combinator
+{
+  explicit resumable_chunk_fn(std::size_t n) : n(n) {}
+
+  std::size_t n;
+
+  template <class G>
+  resumable_chunked<G> operator()(G&& g) const
+  {
+    return resumable_chunked<G>(std::forward<G>(g), n);
+  }
+};
+
+template <class F>
+inline resumable_map_fn<typename std::decay<F>::type> resumable_map(F&& f)
+{
+  return resumable_map_fn<typename std::decay<F>::type>(std::forward<F>(f));
+}
+
+template <class P>
+inline resumable_filter_fn<typename std::decay<P>::type> resumable_filter(P&& p)
+{
+  return resumable_filter_fn<typename std::decay<P>::type>(std::forward<P>(p));
+}
+
+inline resumable_take_fn resumable_take(std::size_t n)
+{
+  return resumable_take_fn(n);
+}
+
+inline resumable_chunk_fn resumable_chunk(std::size_t n)
+{
+  return resumable_chunk_fn(n);
+}
+
+#endif // RESUMABLE_RANGE_HPP
@@ -0,0 +1,214 @@
+#ifndef RESUMABLE_SCHEDULER_HPP
+#define RESUMABLE_SCHEDULER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// A cooperative, single-threaded scheduler that never allocates.
+//
+// A task is a resumable lambda wrapped in resumable_task<F>, which adds the
+// queue link to the lambda's own frame. Posting a task links that frame into
+// the run queue, and running it unlinks it again, so the queue needs no
+// storage of its own. The task object is owned by the caller and must stay
+// where it is while it is queued.
+//
+//   resumable_scheduler sched;
+//   auto t = make_task([&]() resumable
+//     {
+//       ...
+//       yield sched.post(lambda_ref(lambda_this));
+//     });
+//   sched.post(t);
+//   sched.run();
+//
+// Inside the body, lambda_ref(lambda_this) refers to the lambda part of the
+// task, and post() recovers the task that contains it. A task may only be
+// queued once at a time.
+
+class resumable_hook
+{
+public:
+  explicit resumable_hook(void (*resume)(resumable_hook&)) noexcept
+    : resume_(resume)
+  {
+  }
+
+  // A copy is not linked into anything.
+  resumable_hook(const resumable_hook& other) noexcept
+    : resume_(other.resume_)
+  {
+  }
+
+  resumable_hook& operator=(const resumable_hook&) noexcept
+  {
+    return *this;
+  }
+
+  void resume()
+  {
+    resume_(*this);
+  }
+
+private:
+  friend class resumable_scheduler;
+  friend class resumable_stealing_scheduler;
+  friend class resumable_sharded_scheduler;
+  template <std::size_t> friend class resumable_priority_scheduler;
+
+  resumable_hook* next_ = nullptr;
+  void (*resume_)(resumable_hook&);
+
+  // Whether the task is idle, queued or running, for schedulers that resume
+  // tasks on more than one thread.
+  std::atomic<int> state_{0};
+
+  // The key that the task is queued under, for schedulers that do not run
+  // tasks in the order they were posted.
+  std::uint64_t key_ = 0;
+};
+
+template <class F>
+class resumable_task : public resumable_hook, public F
+{
+public:
+  typedef F lambda_type;
+
+  template <class T>
+  explicit resumable_task(T&& t)
+    : resumable_hook(&invoke), F(std::forward<T>(t))
+  {
+  }
+
+  static resumable_task& containing(F& f) noexcept
+  {
+    return static_cast<resumable_task&>(f);
+  }
+
+private:
+  static void invoke(resumable_hook& h)
+  {
+    static_cast<F&>(static_cast<resumable_task&>(h))();
+  }
+};
+
+template <class F>
+inline resumable_task<typename std::decay<F>::type> make_task(F&& f)
+{
+  return resumable_task<typename std::decay<F>::type>(std::forward<F>(f));
+}
+
+// Posts a task back to the scheduler it runs on. Code that finishes
+// something a task is waiting for, such as a channel operation, holds one of
+// these so that it can wake the task without knowing its scheduler's type.
+// Schedulers that resume tasks on more than one thread allow it to be called
+// from any thread, even while the task is still running.
+class resumable_waker
+{
+public:
+  template <class Scheduler, class F>
+  resumable_waker(Scheduler& s, resumable_ref<F> r) noexcept
+    : post_(&post_to<Scheduler>), scheduler_(&s),
+      task_(&resumable_task<F>::containing(r.get()))
+  {
+  }
+
+  // For schedulers that take an index along with the task, such as the
+  // shard of a resumable_sharded_scheduler.
+  template <class Scheduler, class F>
+  resumable_waker(Scheduler& s, unsigned index, resumable_ref<F> r) noexcept
+    : post_(&post_indexed<Scheduler>), scheduler_(&s),
+      task_(&resumable_task<F>::containing(r.get())), index_(index)
+  {
+  }
+
+  void operator()() const
+  {
+    post_(scheduler_, index_, *task_);
+  }
+
+private:
+  template <class Scheduler>
+  static void post_to(void* s, unsigned, resumable_hook& h)
+  {
+    static_cast<Scheduler*>(s)->post(h);
+  }
+
+  template <class Scheduler>
+  static void post_indexed(void* s, unsigned index, resumable_hook& h)
+  {
+    static_cast<Scheduler*>(s)->post(index, h);
+  }
+
+  void (*post_)(void*, unsigned, resumable_hook&);
+  void* scheduler_;
+  resumable_hook* task_;
+  unsigned index_ = 0;
+};
+
+class resumable_scheduler
+{
+public:
+  resumable_scheduler() noexcept
+  {
+  }
+
+  resumable_scheduler(const resumable_scheduler&) = delete;
+  resumable_scheduler& operator=(const resumable_scheduler&) = delete;
+
+  // Links a task at the back of the run queue. Returns 0 so that a task can
+  // write "yield sched.post(...)".
+  int post(resumable_hook& h) noexcept
+  {
+    h.next_ = nullptr;
+    if (last_)
+      last_->next_ = &h;
+    else
+      first_ = &h;
+    last_ = &h;
+    return 0;
+  }
+
+  // Posts the task whose lambda is referred to by r, which must be part of a
+  // resumable_task<F>.
+  template <class F>
+  int post(resumable_ref<F> r) noexcept
+  {
+    return post(resumable_task<F>::containing(r.get()));
+  }
+
+  bool empty() const noexcept
+  {
+    return first_ == nullptr;
+  }
+
+  // Resumes the task at the front of the queue, if there is one.
+  bool run_one()
+  {
+    resumable_hook* h = first_;
+    if (!h)
+      return false;
+    first_ = h->next_;
+    if (!first_)
+      last_ = nullptr;
+    h->next_ = nullptr;
+    h->resume();
+    return true;
+  }
+
+  // Runs tasks until the queue is empty. Returns the number of resumes.
+  std::size_t run()
+  {
+    std::size_t n = 0;
+    while (run_one())
+      ++n;
+    return n;
+  }
+
+private:
+  resumable_hook* first_ = nullptr;
+  resumable_hook* last_ = nullptr;
+};
+
+#endif // RESUMABLE_SCHEDULER_HPP
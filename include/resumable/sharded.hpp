@@ -0,0 +1,446 @@
+#ifndef RESUMABLE_SHARDED_HPP
+#define RESUMABLE_SHARDED_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <resumable/parking.hpp>
+#include <resumable/scheduler.hpp>
+
+// See work_stealing.hpp.
+#pragma push_macro("yield")
+#undef yield
+#include <thread>
+#pragma pop_macro("yield")
+
+#if defined(__linux__)
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+// A thread-per-core scheduler for resumable_task<F> objects, in which every
+// task belongs to one shard and is only ever resumed by that shard's thread.
+// Frames stay in the cache of the core that runs them, at the cost of no
+// load balancing between shards.
+//
+// Each shard runs the same kind of intrusive run queue as
+// resumable_scheduler. A task posted to another shard goes into an outbox,
+// and at the end of each round of resumes the outbox is moved into a
+// single-producer, single-consumer ring for that pair of shards with one
+// release store, so a burst of wake-ups costs the receiver one cache miss
+// rather than one per task. Posts from threads outside the scheduler go
+// through a locked queue. Shards with nothing to do park, as in
+// resumable_stealing_scheduler.
+//
+// A task is posted with the index of its shard, and it is up to the caller
+// to always use the same index for the same task. post() without an index
+// uses the calling thread's shard, which is how a task posts itself:
+//
+//   yield sched.post(lambda_ref(lambda_this));
+//
+// On Linux each shard thread is pinned to one of the CPUs the process may
+// run on, so memory that its tasks allocate is first touched, and so placed,
+// on that shard's memory node. Frames created through resumable_pool come
+// from the shard thread's own cache of free slots, and go back to it when
+// they are released on the same shard.
+//
+// A shard whose mailbox to another shard is full sleeps until the other
+// shard has emptied it, unless it has other work to do.
+
+class resumable_sharded_scheduler
+{
+public:
+  explicit resumable_sharded_scheduler(
+      unsigned shards = std::thread::hardware_concurrency(), bool pin = true)
+  {
+    if (shards == 0)
+      shards = 1;
+    std::vector<int> cpus;
+    if (pin)
+      cpus = allowed_cpus();
+    for (unsigned i = 0; i < shards; ++i)
+      shards_.emplace_back(new shard(*this, i, shards,
+            cpus.empty() ? -1 : cpus[i % cpus.size()]));
+    for (auto& s : shards_)
+      s->thread = std::thread([this, &s] { run(*s); });
+  }
+
+  resumable_sharded_scheduler(const resumable_sharded_scheduler&) = delete;
+  resumable_sharded_scheduler& operator=(const resumable_sharded_scheduler&) = delete;
+
+  // Stops the shards once no task is queued or running.
+  ~resumable_sharded_scheduler()
+  {
+    wait();
+    stopping_.store(true, std::memory_order_seq_cst);
+    for (auto& s : shards_)
+      s->parking.notify_all();
+    for (auto& s : shards_)
+      s->thread.join();
+  }
+
+  // Queues a task on the given shard, unless it is already queued. A running
+  // task is queued again after its current resume. Returns 0 so that a task
+  // can write "yield sched.post(...)".
+  int post(unsigned index, resumable_hook& h)
+  {
+    int s = h.state_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      if (s == idle)
+      {
+        if (h.state_.compare_exchange_weak(s, queued, std::memory_order_acq_rel))
+        {
+          active_.fetch_add(1, std::memory_order_relaxed);
+          route(index, h);
+          return 0;
+        }
+      }
+      else if (s == running)
+      {
+        if (h.state_.compare_exchange_weak(s, notified, std::memory_order_acq_rel))
+          return 0;
+      }
+      else
+      {
+        // Already queued or marked: write the same value back, so that the
+        // resume that takes the task still acquires what was written before
+        // this post.
+        if (h.state_.compare_exchange_weak(s, s, std::memory_order_acq_rel))
+          return 0;
+      }
+    }
+  }
+
+  template <class F>
+  int post(unsigned index, resumable_ref<F> r)
+  {
+    return post(index, resumable_task<F>::containing(r.get()));
+  }
+
+  // Posts to the calling thread's shard, or to shard 0 from any other
+  // thread.
+  int post(resumable_hook& h)
+  {
+    unsigned index = current_shard();
+    return post(index < size() ? index : 0, h);
+  }
+
+  template <class F>
+  int post(resumable_ref<F> r)
+  {
+    return post(resumable_task<F>::containing(r.get()));
+  }
+
+  // The index of the shard running on the calling thread, or size() if the
+  // calling thread is not one of this scheduler's.
+  unsigned current_shard() const noexcept
+  {
+    shard* s = current();
+    return s && &s->owner == this ? s->index : size();
+  }
+
+  unsigned size() const noexcept
+  {
+    return static_cast<unsigned>(shards_.size());
+  }
+
+  // Blocks until no task is queued or running.
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this] { return active_.load(std::memory_order_acquire) == 0; });
+  }
+
+private:
+  enum { idle, queued, running, notified };
+
+  struct queue
+  {
+    resumable_hook* first = nullptr;
+    resumable_hook* last = nullptr;
+
+    bool empty() const noexcept
+    {
+      return first == nullptr;
+    }
+
+    void push_back(resumable_hook* h) noexcept
+    {
+      h->next_ = nullptr;
+      if (last)
+        last->next_ = h;
+      else
+        first = h;
+      last = h;
+    }
+
+    resumable_hook* pop_front() noexcept
+    {
+      resumable_hook* h = first;
+      first = h->next_;
+      if (!first)
+        last = nullptr;
+      h->next_ = nullptr;
+      return h;
+    }
+  };
+
+  // The ring from one shard to another. The producer and consumer each
+  // publish their index once per batch, and the producer only rereads the
+  // consumer's index when the ring looks full.
+  class mailbox
+  {
+  public:
+    static const std::size_t capacity = 256;
+
+    // Moves as many tasks from q as there is room for.
+    // Returns whether any were moved.
+    bool push(queue& q) noexcept
+    {
+      std::size_t t = tail_.load(std::memory_order_relaxed);
+      if (t - head_cache_ == capacity)
+        head_cache_ = head_.load(std::memory_order_acquire);
+      std::size_t n = t;
+      while (!q.empty() && n - head_cache_ < capacity)
+        slots_[n++ % capacity] = q.pop_front();
+      if (n == t)
+        return false;
+      tail_.store(n, std::memory_order_release);
+      return true;
+    }
+
+    // Returns whether there were any.
+    bool pop_all(queue& q) noexcept
+    {
+      std::size_t h = head_.load(std::memory_order_relaxed);
+      std::size_t t = tail_.load(std::memory_order_acquire);
+      if (h == t)
+        return false;
+      for (; h != t; ++h)
+        q.push_back(slots_[h % capacity]);
+      head_.store(h, std::memory_order_release);
+      return true;
+    }
+
+  private:
+    // The producer's and the consumer's fields are on separate cache lines.
+    std::atomic<std::size_t> tail_{0};
+    std::size_t head_cache_ = 0;
+    char pad1_[64];
+    std::atomic<std::size_t> head_{0};
+    char pad2_[64];
+    resumable_hook* slots_[capacity];
+  };
+
+  struct shard
+  {
+    shard(resumable_sharded_scheduler& s, unsigned i, unsigned n, int c)
+      : owner(s), index(i), cpu(c), outbound(new queue[n]), inbound(new mailbox[n])
+    {
+    }
+
+    resumable_sharded_scheduler& owner;
+    unsigned index;
+    int cpu;
+
+    // Only touched by this shard's thread.
+    queue ready;
+    std::unique_ptr<queue[]> outbound;
+
+    // inbound[i] is filled by shard i.
+    std::unique_ptr<mailbox[]> inbound;
+    std::atomic<bool> mail{false};
+
+    std::mutex external_mutex;
+    queue external;
+    std::atomic<bool> has_external{false};
+
+    resumable_parking parking;
+    std::thread thread;
+  };
+
+  static shard*& current() noexcept
+  {
+    static thread_local shard* s = nullptr;
+    return s;
+  }
+
+  static std::vector<int> allowed_cpus()
+  {
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+      for (int i = 0; i < CPU_SETSIZE; ++i)
+        if (CPU_ISSET(i, &set))
+          cpus.push_back(i);
+#endif
+    return cpus;
+  }
+
+  static void pin(int cpu) noexcept
+  {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+  }
+
+  void route(unsigned index, resumable_hook& h)
+  {
+    shard* from_shard = current();
+    if (from_shard && &from_shard->owner == this)
+    {
+      if (from_shard->index == index)
+        from_shard->ready.push_back(&h);
+      else
+        from_shard->outbound[index].push_back(&h);
+    }
+    else
+    {
+      shard& to = *shards_[index];
+      {
+        std::lock_guard<std::mutex> lock(to.external_mutex);
+        to.external.push_back(&h);
+        to.has_external.store(true, std::memory_order_relaxed);
+      }
+      to.parking.notify_one();
+    }
+  }
+
+  // Moves everything sent to s by other threads onto its run queue. A shard
+  // that has made room in a mailbox wakes its sender, in case the sender is
+  // asleep waiting for that.
+  void receive(shard& s)
+  {
+    if (s.mail.exchange(false, std::memory_order_acquire))
+      for (unsigned i = 0; i < size(); ++i)
+        if (s.inbound[i].pop_all(s.ready))
+          shards_[i]->parking.notify_one();
+
+    if (s.has_external.load(std::memory_order_relaxed))
+    {
+      std::lock_guard<std::mutex> lock(s.external_mutex);
+      while (!s.external.empty())
+        s.ready.push_back(s.external.pop_front());
+      s.has_external.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  // Hands the tasks that s has posted to other shards to their mailboxes.
+  // Returns whether any are left over because a mailbox was full, and sets
+  // moved if any were handed over.
+  bool send(shard& s, bool& moved)
+  {
+    bool left = false;
+    for (unsigned i = 0; i < size(); ++i)
+    {
+      queue& q = s.outbound[i];
+      if (q.empty())
+        continue;
+      shard& to = *shards_[i];
+      if (to.inbound[s.index].push(q))
+      {
+        moved = true;
+        to.mail.store(true, std::memory_order_release);
+        to.parking.notify_one();
+      }
+      left = left || !q.empty();
+    }
+    return left;
+  }
+
+  void resume(shard& s, resumable_hook& h)
+  {
+    // Sequentially consistent on both sides, so that a post that finds the
+    // task still queued is sure to be followed by a resume that sees
+    // whatever the poster wrote before it.
+    h.state_.exchange(running, std::memory_order_acq_rel);
+    h.resume();
+    int st = running;
+    if (h.state_.compare_exchange_strong(st, idle, std::memory_order_acq_rel))
+    {
+      if (active_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_cv_.notify_all();
+      }
+    }
+    else
+    {
+      h.state_.store(queued, std::memory_order_relaxed);
+      s.ready.push_back(&h);
+    }
+  }
+
+  void run(shard& s)
+  {
+    current() = &s;
+    if (s.cpu >= 0)
+      pin(s.cpu);
+
+    for (;;)
+    {
+      receive(s);
+
+      // Tasks that are posted during this round run in the next one, after
+      // anything that has arrived from other shards in the meantime.
+      queue round = s.ready;
+      s.ready = queue();
+      while (!round.empty())
+        resume(s, *round.pop_front());
+
+      bool moved = false;
+      bool left = send(s, moved);
+      if (!s.ready.empty())
+        continue;
+
+      // With tasks left over for a full mailbox, the last look for work
+      // includes another try at sending them. The receiving shard notifies
+      // this one whenever it empties the mailbox.
+      std::uint32_t e = s.parking.prepare();
+      if (left)
+      {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        moved = false;
+        send(s, moved);
+        if (moved)
+        {
+          s.parking.cancel();
+          continue;
+        }
+      }
+      if (s.mail.load(std::memory_order_seq_cst)
+          || s.has_external.load(std::memory_order_seq_cst))
+      {
+        s.parking.cancel();
+        continue;
+      }
+      if (stopping_.load(std::memory_order_seq_cst))
+      {
+        s.parking.cancel();
+        break;
+      }
+      s.parking.wait(e);
+    }
+
+    current() = nullptr;
+  }
+
+  std::vector<std::unique_ptr<shard>> shards_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<std::size_t> active_{0};
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+};
+
+#endif // RESUMABLE_SHARDED_HPP
@@ -0,0 +1,215 @@
+#ifndef RESUMABLE_TEE_HPP
+#define RESUMABLE_TEE_HPP
+
+#include <cstddef>
+#include <deque>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Shares one run of a generator between several readers.
+//
+// Each value is pulled from the underlying generator once, by whichever
+// reader gets to it first, and is kept in a queue of fixed-size chunks until
+// every reader has gone past it. Chunks that the slowest reader has left are
+// recycled, so memory is bounded by how far apart the fastest and slowest
+// readers drift rather than by the length of the sequence.
+//
+//   resumable_shared_generator<decltype(parse)> shared(std::move(parse));
+//   auto a = shared.make_reader();
+//   auto b = shared.make_reader();
+//
+// Readers are generators themselves, with operator() and is_terminal(). They
+// refer to the resumable_shared_generator, which must outlive them.
+
+template <class G, std::size_t ChunkSize = 64>
+class resumable_shared_generator
+{
+public:
+  typedef typename std::decay<decltype(std::declval<G&>()())>::type value_type;
+
+  class reader
+  {
+  public:
+    reader(const reader& other)
+      : shared_(other.shared_),
+        slot_(shared_->attach(shared_->positions_[other.slot_]))
+    {
+    }
+
+    reader(reader&& other) noexcept
+      : shared_(other.shared_), slot_(other.slot_)
+    {
+      other.shared_ = nullptr;
+    }
+
+    reader& operator=(const reader&) = delete;
+
+    reader& operator=(reader&& other) noexcept
+    {
+      if (this != &other)
+      {
+        if (shared_)
+          shared_->detach(slot_);
+        shared_ = other.shared_;
+        slot_ = other.slot_;
+        other.shared_ = nullptr;
+      }
+      return *this;
+    }
+
+    ~reader()
+    {
+      if (shared_)
+        shared_->detach(slot_);
+    }
+
+    // A reader that has been moved from is terminal.
+    bool is_terminal() const noexcept(noexcept(::is_terminal(std::declval<const G&>())))
+    {
+      return !shared_ || (shared_->positions_[slot_] == shared_->produced_
+        && ::is_terminal(shared_->g_));
+    }
+
+    value_type operator()()
+    {
+      return shared_->next(slot_);
+    }
+
+  private:
+    friend class resumable_shared_generator;
+
+    reader(resumable_shared_generator* shared, std::size_t slot) noexcept
+      : shared_(shared), slot_(slot)
+    {
+    }
+
+    resumable_shared_generator* shared_;
+    std::size_t slot_;
+  };
+
+  explicit resumable_shared_generator(G&& g)
+    : g_(std::forward<G>(g))
+  {
+  }
+
+  resumable_shared_generator(const resumable_shared_generator&) = delete;
+  resumable_shared_generator& operator=(const resumable_shared_generator&) = delete;
+
+  ~resumable_shared_generator()
+  {
+    for (std::size_t i = base_; i < produced_; ++i)
+      at(i)->~value_type();
+    for (chunk* c : chunks_)
+      delete c;
+    for (chunk* c : spare_)
+      delete c;
+  }
+
+  // Adds a reader positioned at the oldest value still held, which is the
+  // start of the sequence until the readers have moved on from it.
+  reader make_reader()
+  {
+    return reader(this, attach(base_));
+  }
+
+  // The number of values currently held for readers that have yet to see
+  // them.
+  std::size_t buffered() const noexcept
+  {
+    return produced_ - base_;
+  }
+
+private:
+  static const std::size_t npos = static_cast<std::size_t>(-1);
+
+  struct chunk
+  {
+    typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type values[ChunkSize];
+  };
+
+  value_type* at(std::size_t i) noexcept
+  {
+    chunk* c = chunks_[(i - base_) / ChunkSize];
+    return reinterpret_cast<value_type*>(&c->values[i % ChunkSize]);
+  }
+
+  std::size_t attach(std::size_t position)
+  {
+    for (std::size_t slot = 0; slot < positions_.size(); ++slot)
+    {
+      if (positions_[slot] == npos)
+      {
+        positions_[slot] = position;
+        return slot;
+      }
+    }
+    positions_.push_back(position);
+    return positions_.size() - 1;
+  }
+
+  void detach(std::size_t slot) noexcept
+  {
+    positions_[slot] = npos;
+    trim();
+  }
+
+  value_type next(std::size_t slot)
+  {
+    std::size_t& position = positions_[slot];
+    if (position == produced_)
+    {
+      if (produced_ == base_ + chunks_.size() * ChunkSize)
+        chunks_.push_back(new_chunk());
+      new (at(produced_)) value_type(g_());
+      ++produced_;
+    }
+
+    value_type v(*at(position));
+    if (++position % ChunkSize == 0)
+      trim();
+    return v;
+  }
+
+  chunk* new_chunk()
+  {
+    if (spare_.empty())
+      return new chunk;
+    chunk* c = spare_.back();
+    spare_.pop_back();
+    return c;
+  }
+
+  // Releases the chunks that every reader has finished with. Called whenever
+  // a reader crosses into a new chunk or goes away.
+  void trim() noexcept
+  {
+    std::size_t slowest = produced_;
+    for (std::size_t p : positions_)
+      if (p < slowest)
+        slowest = p;
+
+    while (!chunks_.empty() && slowest - base_ >= ChunkSize)
+    {
+      for (std::size_t i = base_; i < base_ + ChunkSize; ++i)
+        at(i)->~value_type();
+      chunk* c = chunks_.front();
+      chunks_.pop_front();
+      base_ += ChunkSize;
+      if (spare_.size() < 2)
+        spare_.push_back(c);
+      else
+        delete c;
+    }
+  }
+
+  G g_;
+  std::deque<chunk*> chunks_;
+  std::vector<chunk*> spare_;
+  std::vector<std::size_t> positions_;
+  std::size_t base_ = 0;
+  std::size_t produced_ = 0;
+};
+
+#endif // RESUMABLE_TEE_HPP
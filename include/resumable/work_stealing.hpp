@@ -0,0 +1,388 @@
+#ifndef RESUMABLE_WORK_STEALING_HPP
+#define RESUMABLE_WORK_STEALING_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <resumable/parking.hpp>
+#include <resumable/scheduler.hpp>
+
+// The yield macro seen by code being transformed would otherwise rename
+// std::this_thread::yield.
+#pragma push_macro("yield")
+#undef yield
+#include <thread>
+#pragma pop_macro("yield")
+
+// A multi-threaded scheduler for the same resumable_task<F> objects as
+// resumable_scheduler.
+//
+// Each worker thread has a Chase-Lev deque. Tasks posted from a worker go on
+// the bottom of its own deque and are taken from there, most recent first.
+// A worker with nothing to do steals the oldest task from the top of another
+// worker's deque. Tasks posted from other threads go on a shared injection
+// queue. Idle workers park on a futex, or on a condition variable where
+// futexes are not available, and a post wakes one of them.
+//
+// A task is idle, queued or running. Posting an idle task queues it. Posting
+// a running task, including a task posting itself, only marks it, and the
+// worker queues it again once the current resume has returned. So a task is
+// never resumed on two threads at once, and a self-posting task cannot be
+// stolen while it is still returning from the resume that posted it.
+//
+// Memory ordering: everything a resume writes to the frame, including its
+// state, happens before the next resume of that frame, on whichever worker.
+// The worker releases the task when it finishes a resume, either by marking
+// it idle or by pushing it back on a deque. Whoever queues or takes it next
+// does so with an acquire operation. Every post changes the task's state
+// with a read-modify-write that releases, even one that finds the task
+// already queued and writes the same state back. The worker marks the task
+// running with an exchange that acquires. Either that exchange reads a state
+// written by the post, or by something later, so the resume sees everything
+// written before the post, or the post sees the task running, and has it
+// queued again.
+
+class resumable_stealing_scheduler
+{
+public:
+  explicit resumable_stealing_scheduler(unsigned threads = std::thread::hardware_concurrency())
+  {
+    if (threads == 0)
+      threads = 1;
+    for (unsigned i = 0; i < threads; ++i)
+      workers_.emplace_back(new worker(*this, i));
+    for (auto& w : workers_)
+      w->thread_ = std::thread([this, &w] { w->run(); });
+  }
+
+  resumable_stealing_scheduler(const resumable_stealing_scheduler&) = delete;
+  resumable_stealing_scheduler& operator=(const resumable_stealing_scheduler&) = delete;
+
+  // Stops the workers once no task is queued or running.
+  ~resumable_stealing_scheduler()
+  {
+    wait();
+    stopping_.store(true, std::memory_order_seq_cst);
+    parking_.notify_all();
+    for (auto& w : workers_)
+      w->thread_.join();
+  }
+
+  // Queues a task, unless it is already queued. A running task is queued
+  // again after its current resume. Returns 0 so that a task can write
+  // "yield sched.post(...)".
+  int post(resumable_hook& h)
+  {
+    int s = h.state_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      if (s == idle)
+      {
+        if (h.state_.compare_exchange_weak(s, queued, std::memory_order_acq_rel))
+        {
+          active_.fetch_add(1, std::memory_order_relaxed);
+          push(h);
+          return 0;
+        }
+      }
+      else if (s == running)
+      {
+        if (h.state_.compare_exchange_weak(s, notified, std::memory_order_acq_rel))
+          return 0;
+      }
+      else
+      {
+        // Already queued or marked: write the same value back, so that the
+        // resume that takes the task still acquires what was written before
+        // this post.
+        if (h.state_.compare_exchange_weak(s, s, std::memory_order_acq_rel))
+          return 0;
+      }
+    }
+  }
+
+  template <class F>
+  int post(resumable_ref<F> r)
+  {
+    return post(resumable_task<F>::containing(r.get()));
+  }
+
+  // Blocks until no task is queued or running. Tasks that are idle without
+  // having terminated are waiting to be posted by someone else, and do not
+  // count.
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this] { return active_.load(std::memory_order_acquire) == 0; });
+  }
+
+  std::size_t size() const noexcept
+  {
+    return workers_.size();
+  }
+
+private:
+  enum { idle, queued, running, notified };
+
+  // The Chase-Lev deque, following the C11 formulation by Le, Pop, Cohen and
+  // Zappa Nardelli. Buffers replaced by growth are kept until the deque is
+  // destroyed, since a thief may still be reading from them.
+  class deque
+  {
+  public:
+    deque()
+      : buffer_(new buffer(64))
+    {
+      array_.store(buffer_.get(), std::memory_order_relaxed);
+    }
+
+    // Only called by the owning worker.
+    void push(resumable_hook* h)
+    {
+      std::int64_t b = bottom_.load(std::memory_order_relaxed);
+      std::int64_t t = top_.load(std::memory_order_acquire);
+      buffer* a = array_.load(std::memory_order_relaxed);
+      if (b - t > static_cast<std::int64_t>(a->size) - 1)
+        a = grow(a, t, b);
+      a->at(b).store(h, std::memory_order_relaxed);
+      bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    // Only called by the owning worker.
+    resumable_hook* take()
+    {
+      std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+      buffer* a = array_.load(std::memory_order_relaxed);
+      bottom_.store(b, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      std::int64_t t = top_.load(std::memory_order_relaxed);
+      resumable_hook* h = nullptr;
+      if (t <= b)
+      {
+        h = a->at(b).load(std::memory_order_relaxed);
+        if (t == b)
+        {
+          if (!top_.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed))
+            h = nullptr;
+          bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+      }
+      else
+      {
+        bottom_.store(b + 1, std::memory_order_relaxed);
+      }
+      return h;
+    }
+
+    // Called by any other worker.
+    resumable_hook* steal()
+    {
+      std::int64_t t = top_.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      std::int64_t b = bottom_.load(std::memory_order_acquire);
+      if (t >= b)
+        return nullptr;
+      buffer* a = array_.load(std::memory_order_acquire);
+      resumable_hook* h = a->at(t).load(std::memory_order_relaxed);
+      if (!top_.compare_exchange_strong(t, t + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+      return h;
+    }
+
+  private:
+    struct buffer
+    {
+      explicit buffer(std::size_t n)
+        : size(n), slots(new std::atomic<resumable_hook*>[n])
+      {
+      }
+
+      std::atomic<resumable_hook*>& at(std::int64_t i) noexcept
+      {
+        return slots[static_cast<std::size_t>(i) & (size - 1)];
+      }
+
+      std::size_t size;
+      std::unique_ptr<std::atomic<resumable_hook*>[]> slots;
+      std::unique_ptr<buffer> prev;
+    };
+
+    buffer* grow(buffer* a, std::int64_t t, std::int64_t b)
+    {
+      std::unique_ptr<buffer> bigger(new buffer(a->size * 2));
+      for (std::int64_t i = t; i < b; ++i)
+        bigger->at(i).store(a->at(i).load(std::memory_order_relaxed), std::memory_order_relaxed);
+      bigger->prev = std::move(buffer_);
+      buffer_ = std::move(bigger);
+      array_.store(buffer_.get(), std::memory_order_release);
+      return buffer_.get();
+    }
+
+    // Thieves write top_ and the owner writes bottom_, so they are kept on
+    // separate cache lines.
+    std::atomic<std::int64_t> top_{0};
+    char pad_[64];
+    std::atomic<std::int64_t> bottom_{0};
+    std::atomic<buffer*> array_{nullptr};
+    std::unique_ptr<buffer> buffer_;
+  };
+
+  struct worker
+  {
+    worker(resumable_stealing_scheduler& s, unsigned i)
+      : owner(s), index(i), seed(i * 2654435761u + 1)
+    {
+    }
+
+    void run()
+    {
+      current() = this;
+      owner.work(*this);
+      current() = nullptr;
+    }
+
+    unsigned next_random() noexcept
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      return seed;
+    }
+
+    resumable_stealing_scheduler& owner;
+    unsigned index;
+    unsigned seed;
+    deque tasks;
+    std::thread thread_;
+  };
+
+  static worker*& current() noexcept
+  {
+    static thread_local worker* w = nullptr;
+    return w;
+  }
+
+  void push(resumable_hook& h)
+  {
+    worker* w = current();
+    if (w && &w->owner == this)
+    {
+      w->tasks.push(&h);
+    }
+    else
+    {
+      std::lock_guard<std::mutex> lock(inject_mutex_);
+      h.next_ = nullptr;
+      if (inject_last_)
+        inject_last_->next_ = &h;
+      else
+        inject_first_ = &h;
+      inject_last_ = &h;
+      injected_.store(true, std::memory_order_relaxed);
+    }
+    parking_.notify_one();
+  }
+
+  resumable_hook* pop_injected()
+  {
+    if (!injected_.load(std::memory_order_relaxed))
+      return nullptr;
+    std::lock_guard<std::mutex> lock(inject_mutex_);
+    resumable_hook* h = inject_first_;
+    if (h)
+    {
+      inject_first_ = h->next_;
+      if (!inject_first_)
+      {
+        inject_last_ = nullptr;
+        injected_.store(false, std::memory_order_relaxed);
+      }
+      h->next_ = nullptr;
+    }
+    return h;
+  }
+
+  resumable_hook* find_work(worker& w)
+  {
+    if (resumable_hook* h = w.tasks.take())
+      return h;
+    if (resumable_hook* h = pop_injected())
+      return h;
+    std::size_t n = workers_.size();
+    std::size_t start = w.next_random() % n;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      worker& victim = *workers_[(start + i) % n];
+      if (&victim != &w)
+        if (resumable_hook* h = victim.tasks.steal())
+          return h;
+    }
+    return nullptr;
+  }
+
+  void resume(worker& w, resumable_hook& h)
+  {
+    h.state_.exchange(running, std::memory_order_acq_rel);
+    h.resume();
+    int s = running;
+    if (h.state_.compare_exchange_strong(s, idle, std::memory_order_acq_rel))
+    {
+      if (active_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_cv_.notify_all();
+      }
+    }
+    else
+    {
+      h.state_.store(queued, std::memory_order_relaxed);
+      w.tasks.push(&h);
+      parking_.notify_one();
+    }
+  }
+
+  void work(worker& w)
+  {
+    for (;;)
+    {
+      if (resumable_hook* h = find_work(w))
+      {
+        resume(w, *h);
+        continue;
+      }
+
+      std::uint32_t e = parking_.prepare();
+      if (resumable_hook* h = find_work(w))
+      {
+        parking_.cancel();
+        resume(w, *h);
+        continue;
+      }
+      if (stopping_.load(std::memory_order_seq_cst))
+      {
+        parking_.cancel();
+        return;
+      }
+      parking_.wait(e);
+    }
+  }
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  resumable_parking parking_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<std::size_t> active_{0};
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+  std::mutex inject_mutex_;
+  resumable_hook* inject_first_ = nullptr;
+  resumable_hook* inject_last_ = nullptr;
+  std::atomic<bool> injected_{false};
+};
+
+#endif // RESUMABLE_WORK_STEALING_HPP
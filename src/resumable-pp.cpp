@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <iostream>
 #include <map>
 #include <set>
@@ -29,12 +30,21 @@ using namespace clang::tooling;
 std::string allowed_path;
 bool verbose = false;
 bool line_numbers = false;
+// -i: ask the compiler to inline a statically known "yield from" operand
+// into its parent. This is an inlining hint only; the two state machines are
+// not merged.
+bool inline_generators = false;
+bool batch_yields = false;
+std::size_t spill_threshold = 0;
+bool preemption_points = false;
+bool constexpr_lambdas = false;
 
 //------------------------------------------------------------------------------
 // The following code is injected at the beginning of the preprocessor input.
 
 const char injected[] = R"-(
 
+#include <cstddef>
 #include <typeinfo>
 #include <type_traits>
 
@@ -102,19 +112,56 @@ struct __initializer : _T
   typedef _T generator_type;
 };
 
+template <class _T>
+struct resumable_ref
+{
+  typedef _T type;
+  explicit resumable_ref(_T* __p) noexcept : __p_(__p) {}
+  _T& get() const noexcept { return *__p_; }
+  template <class... _Args> auto operator()(_Args&&... __args) const
+    -> decltype(::std::declval<_T&>()(static_cast<_Args&&>(__args)...));
+  _T* __p_;
+};
+
+template <class _T> resumable_ref<_T> lambda_ref(_T* __p) noexcept { return resumable_ref<_T>(__p); }
+inline resumable_ref<__lambda_this_t> lambda_ref(__lambda_this_t) noexcept { return resumable_ref<__lambda_this_t>(nullptr); }
+
 template <class _T> bool is_initial(const _T&) noexcept { return false; }
 template <class _T> bool is_terminal(const _T&) noexcept { return false; }
+template <class _T> bool is_preempted(const _T&) noexcept { return false; }
+template <class _T> int resumable_state(const _T&) noexcept { return 0; }
+template <class _T> void reset(_T&) noexcept {}
+template <class _T, class... _Args> void rebind(_T&, _Args&&...) {}
+inline void set_preemption_budget(unsigned) noexcept {}
+#if defined(__GXX_RTTI) || defined(_CPPRTTI) || defined(__cpp_rtti)
 template <class _T> const std::type_info& wanted_type(const _T&) noexcept { return typeid(void); }
+#endif
 template <class _T> void* wanted(_T&) noexcept { return nullptr; }
 template <class _T> const void* wanted(const _T&) noexcept { return nullptr; }
+typedef const void* resumable_type_id;
+template <class _T> constexpr resumable_type_id resumable_type_id_of() noexcept { return nullptr; }
+template <class _T> void* wanted(_T&, resumable_type_id) noexcept { return nullptr; }
+template <class _W, class _T> _W* wanted_as(_T&) noexcept { return nullptr; }
+template <class _G, class _T> _G* delegate(_T&) noexcept { return nullptr; }
+template <class _G, class _T> std::size_t resume_n(_G&, _T*, std::size_t) { return 0; }
 template <class _T> __initializer<_T> initializer(_T __t) { return __initializer<_T>(static_cast<_T&&>(__t)); }
 template <class _T> struct lambda { typedef _T type; };
 template <class _T> using lambda_t = typename lambda<_T>::type;
+template <class _T> struct resumable_frame_traits
+{
+  typedef lambda_t<_T> frame_type;
+  static constexpr std::size_t size = sizeof(frame_type);
+  static constexpr std::size_t alignment = alignof(frame_type);
+  static constexpr bool is_trivially_relocatable = false;
+};
+template <class _T> lambda_t<typename std::decay<_T>::type>* emplace_into(void*, _T&&) { return nullptr; }
+template <class _F> void destroy_frame(_F*) noexcept {}
 
 #define resumable __attribute__((__annotate__("resumable"))) mutable
 #define yield 0 ? throw __yield : __yield=
 #define from __from=
 #define lambda_this __lambda_this
+#define resumable_spill __attribute__((__annotate__("resumable_spill")))
 
 )-";
 
@@ -289,6 +336,7 @@ public:
     std::string full_name;
     std::string generator_expr;
     int yield_id;
+    bool spilled;
   };
 
   typedef std::vector<int> scope_path;
@@ -359,6 +407,27 @@ public:
     return curr_yield_id_;
   }
 
+  int getPreemptionId(CompoundStmt* stmt)
+  {
+    auto iter = preemption_yield_.find(stmt);
+    return iter != preemption_yield_.end() ? iter->second : 0;
+  }
+
+  bool hasPreemptionPoints() const
+  {
+    return !preemption_yield_.empty();
+  }
+
+  std::map<CompoundStmt*, int>::const_iterator preemption_begin() const
+  {
+    return preemption_yield_.begin();
+  }
+
+  std::map<CompoundStmt*, int>::const_iterator preemption_end() const
+  {
+    return preemption_yield_.end();
+  }
+
   int getPriorYieldId(int yield_id)
   {
     auto iter = yield_to_prior_yield_.find(yield_id);
@@ -376,11 +445,36 @@ public:
     return is_reachable_yield_.count(std::make_pair(from_yield_id, to_yield_id)) > 0;
   }
 
+  bool isReturnFrom(int yield_id)
+  {
+    return return_from_yield_.count(yield_id) > 0;
+  }
+
+  bool hasReturnFrom() const
+  {
+    return !return_from_yield_.empty();
+  }
+
   bool hasVoidReturn() const
   {
     return has_void_return_;
   }
 
+  bool hasPlainReturn() const
+  {
+    return has_plain_return_;
+  }
+
+  bool hasLambdaGenerator() const
+  {
+    return has_lambda_generator_;
+  }
+
+  VarDecl* getDependentLocal() const
+  {
+    return dependent_local_;
+  }
+
   bool TraverseCompoundStmt(CompoundStmt* stmt)
   {
     int curr_scope_id = next_scope_id_;
@@ -389,6 +483,12 @@ public:
     int enclosing_scope_yield_id = curr_scope_yield_id_;
     ptr_to_yield_[stmt] = enclosing_scope_yield_id;
 
+    // Each iteration of a loop starts with a preemption check, which gets
+    // its own state. At the top of the body a "continue" cannot skip it, and
+    // none of the body's locals are live yet.
+    if (loop_bodies_.count(stmt))
+      preemption_yield_[stmt] = NewYieldPoint();
+
     for (CompoundStmt::body_iterator b = stmt->body_begin(), e = stmt->body_end(); b != e; ++b)
     {
       TraverseStmt(*b);
@@ -425,6 +525,7 @@ public:
     if (stmt->getInc())
       TraverseStmt(stmt->getInc());
 
+    AddLoopBody(stmt, stmt->getBody());
     TraverseStmt(stmt->getBody());
 
     curr_scope_yield_id_ = enclosing_scope_yield_id;
@@ -448,6 +549,7 @@ public:
     curr_scope_path_.push_back(next_scope_id_);
     next_scope_id_ = 0;
 
+    AddLoopBody(stmt, stmt->getBody());
     TraverseStmt(stmt->getBody());
 
     curr_scope_yield_id_ = enclosing_scope_yield_id;
@@ -458,6 +560,26 @@ public:
     return true;
   }
 
+  bool TraverseDoStmt(DoStmt* stmt)
+  {
+    AddLoopBody(stmt, stmt->getBody());
+    return RecursiveASTVisitor<resumable_lambda_locals>::TraverseDoStmt(stmt);
+  }
+
+  bool TraverseCXXForRangeStmt(CXXForRangeStmt* stmt)
+  {
+    AddLoopBody(stmt, nullptr);
+    return RecursiveASTVisitor<resumable_lambda_locals>::TraverseCXXForRangeStmt(stmt);
+  }
+
+  bool TraverseLambdaExpr(LambdaExpr* expr)
+  {
+    ++nesting_level_;
+    bool result = RecursiveASTVisitor<resumable_lambda_locals>::TraverseLambdaExpr(expr);
+    --nesting_level_;
+    return result;
+  }
+
   bool TraverseIfStmt(IfStmt* stmt)
   {
     int curr_scope_id = next_scope_id_;
@@ -494,17 +616,28 @@ public:
 
     if (decl->hasLocalStorage())
     {
+      // A frame's layout is fixed before any "auto" parameter is known, so
+      // a local cannot have a type that depends on one.
+      QualType local_type = decl->getType();
+      if (local_type->isDependentType() || (decl->hasInit()
+            && decl->getInit()->isTypeDependent() && !local_type->isScalarType()))
+        if (!dependent_local_)
+          dependent_local_ = decl;
+
       int yield_id = AddYieldPoint(decl);
       std::string inner_type = decl->getType().getAsString();
       if (inner_type.find("class ") == 0) inner_type = inner_type.substr(6);
       if (inner_type.find("struct ") == 0) inner_type = inner_type.substr(7);
-      std::string type = "__resumable_local_type_t<" + inner_type + ">";
+      bool spilled = IsSpilled(decl);
+      std::string type = spilled
+        ? "__resumable_spilled_local<" + inner_type + ">"
+        : "__resumable_local_type_t<" + inner_type + ">";
       std::string name = decl->getDeclName().getAsString();
       std::string full_name;
       for (int scope: curr_scope_path_)
         full_name += "__s" + std::to_string(scope) + ".";
       full_name += name;
-      iterator iter = scope_to_local_.insert(std::make_pair(curr_scope_path_, local{type, name, full_name, "", yield_id}));
+      iterator iter = scope_to_local_.insert(std::make_pair(curr_scope_path_, local{type, name, full_name, "", yield_id, spilled}));
       ptr_to_iter_[decl] = iter;
 
       if (decl->hasInit())
@@ -532,12 +665,28 @@ public:
             }
           }
         }
+        else if (spilled)
+        {
+          std::string init = "new (static_cast<void*>(&" + full_name + ")) " + type + "()";
+          init += ", this->__state = " + std::to_string(yield_id) + ", (*" + full_name + ")";
+          SourceRange range(decl->getLocStart(), decl->getLocation());
+          rewriter_.ReplaceText(range, init);
+        }
         else
         {
           SourceRange range(decl->getLocStart(), decl->getLocation());
           rewriter_.ReplaceText(range, full_name);
         }
       }
+      else if (spilled)
+      {
+        yield_to_iter_[yield_id] = iter;
+
+        std::string init = "new (static_cast<void*>(&" + full_name + ")) " + type + "()";
+        init += ", this->__state = " + std::to_string(yield_id);
+        SourceRange range(decl->getLocStart(), decl->getLocEnd());
+        rewriter_.ReplaceText(range, init);
+      }
       else
       {
         SourceRange range(decl->getLocStart(), decl->getLocEnd());
@@ -589,14 +738,19 @@ public:
 
       if (MaterializeTemporaryExpr* temp = dyn_cast<MaterializeTemporaryExpr>(after_from))
       {
-        AddGenerator(stmt, temp);
+        return_from_yield_.insert(AddGenerator(stmt, temp));
 
         return result;
       }
 
       int yield_id = AddYieldPoint(stmt);
+      return_from_yield_.insert(yield_id);
       yield_to_subgen_[yield_id] = rewriter_.getRewrittenText(SourceRange(after_from->getLocStart(), after_from->getLocEnd().getLocWithOffset(1)));
     }
+    else
+    {
+      has_plain_return_ = true;
+    }
 
     return result;
   }
@@ -631,7 +785,10 @@ public:
     iterator iter = find(expr->getDecl());
     if (iter != end())
     {
-      rewriter_.ReplaceText(SourceRange(expr->getLocStart(), expr->getLocEnd()), iter->second.full_name);
+      std::string name = iter->second.full_name;
+      if (iter->second.spilled)
+        name = "(*" + name + ")";
+      rewriter_.ReplaceText(SourceRange(expr->getLocStart(), expr->getLocEnd()), name);
     }
     else if (expr->getDecl()->getType().getAsString() == "const struct __lambda_this_t")
     {
@@ -656,11 +813,56 @@ public:
   }
 
 private:
+  // Locals marked resumable_spill, or at least as large as the -s threshold,
+  // live in a separate allocation so that the frame itself stays small.
+  bool IsSpilled(VarDecl* decl)
+  {
+    QualType type = decl->getType();
+    if (type->isReferenceType() || type->isDependentType() || type->isIncompleteType())
+      return false;
+
+    AnnotateAttr* attr = decl->getAttr<AnnotateAttr>();
+    if (attr && attr->getAnnotation() == "resumable_spill")
+      return true;
+
+    if (spill_threshold == 0)
+      return false;
+
+    std::size_t size = decl->getASTContext().getTypeSizeInChars(type).getQuantity();
+    return size >= spill_threshold;
+  }
+
+  // A loop whose body is not a compound statement, or a range-based for
+  // loop, has nowhere to put a preemption check, so it is reported instead.
+  void AddLoopBody(Stmt* loop, Stmt* body)
+  {
+    if (!preemption_points || nesting_level_ != 0)
+      return;
+
+    if (CompoundStmt* stmt = dyn_cast_or_null<CompoundStmt>(body))
+    {
+      loop_bodies_.insert(stmt);
+      return;
+    }
+
+    DiagnosticsEngine& diags = rewriter_.getSourceMgr().getDiagnostics();
+    unsigned id = diags.getCustomDiagID(DiagnosticsEngine::Warning,
+        "no preemption check inserted in this loop: %0");
+    diags.Report(loop->getLocStart(), id)
+        << (body ? "its body is not a compound statement" : "range-based for loops are not supported");
+  }
+
   int AddYieldPoint(void* ptr)
+  {
+    int yield_id = NewYieldPoint();
+    ptr_to_yield_[ptr] = yield_id;
+    return yield_id;
+  }
+
+  int NewYieldPoint()
   {
     int yield_id = ++curr_yield_id_;
     int prior_yield_id = curr_scope_yield_id_;
-    ptr_to_yield_[ptr] = yield_id;
     yield_to_prior_yield_[yield_id] = prior_yield_id;
     curr_scope_yield_id_ = yield_id;
     while (prior_yield_id > 0)
@@ -671,7 +873,7 @@ private:
     return yield_id;
   }
 
-  void AddGenerator(Stmt* parent, MaterializeTemporaryExpr* temp)
+  int AddGenerator(Stmt* parent, MaterializeTemporaryExpr* temp)
   {
     int curr_scope_id = next_scope_id_;
     curr_scope_path_.push_back(curr_scope_id);
@@ -682,7 +884,10 @@ private:
 
     std::string inner_type = "typename ::std::decay<" + temp->getType().getAsString() + ">::type";
     if (inner_type.find("lambda at") != std::string::npos)
+    {
       inner_type = "decltype(" + rewriter_.ConvertToString(temp) + ")";
+      has_lambda_generator_ = true;
+    }
     std::string type = "__resumable_generator_type_t<" + inner_type + ">";
     std::string name = "__temp" + std::to_string(temp_yield_id);
     std::string full_name;
@@ -695,7 +900,7 @@ private:
     expr += "__resumable_generator_construct(&" + full_name + ", ";
     expr += rewriter_.getRewrittenText(SourceRange(temp->getLocStart(), temp->getLocEnd())) + ")";
 
-    iterator iter = scope_to_local_.insert(std::make_pair(curr_scope_path_, local{type, name, full_name, expr, temp_yield_id}));
+    iterator iter = scope_to_local_.insert(std::make_pair(curr_scope_path_, local{type, name, full_name, expr, temp_yield_id, false}));
     ptr_to_iter_[temp] = iter;
     yield_to_iter_[temp_yield_id] = iter;
 
@@ -711,6 +916,8 @@ private:
     curr_scope_yield_id_ = enclosing_scope_yield_id;
     curr_scope_path_.pop_back();
     next_scope_id_ = curr_scope_id + 1;
+
+    return yield_id;
   }
 
   Rewriter& rewriter_;
@@ -726,7 +933,14 @@ private:
   std::unordered_map<int, int> yield_to_prior_yield_;
   std::set<std::pair<int, int>> is_reachable_yield_;
   std::unordered_map<int, std::string> yield_to_subgen_;
+  std::set<int> return_from_yield_;
+  std::set<CompoundStmt*> loop_bodies_;
+  std::map<CompoundStmt*, int> preemption_yield_;
+  int nesting_level_ = 0;
   bool has_void_return_ = false;
+  bool has_plain_return_ = false;
+  bool has_lambda_generator_ = false;
+  VarDecl* dependent_local_ = nullptr;
 };
 
 //------------------------------------------------------------------------------
@@ -751,6 +965,15 @@ public:
       return;
 
     locals_.Build();
+    if (VarDecl* decl = locals_.getDependentLocal())
+    {
+      DiagnosticsEngine& diags = rewriter_.getSourceMgr().getDiagnostics();
+      unsigned id = diags.getCustomDiagID(DiagnosticsEngine::Error,
+          "resumable lambda local '%0' has a type that depends on an 'auto' parameter");
+      diags.Report(decl->getLocation(), id) << decl->getName();
+      return;
+    }
+
     CompoundStmt* body = lambda_expr_->getBody();
     SourceRange beforeBody(lambda_expr_->getLocStart(), body->getLocStart());
     SourceRange afterBody(body->getLocEnd(), lambda_expr_->getLocEnd());
@@ -768,29 +991,22 @@ public:
     before << "\n";
     before << "  struct __resumable_lambda_" << lambda_id_ << "_locals_data\n";
     before << "  {\n";
-    before << "    __resumable_lambda_" << lambda_id_ << "_locals_data() {}\n";
+    if (IsConstexpr())
+      before << "    constexpr __resumable_lambda_" << lambda_id_ << "_locals_data() : __state(0) {}\n";
+    else
+      before << "    __resumable_lambda_" << lambda_id_ << "_locals_data() {}\n";
     before << "    __resumable_lambda_" << lambda_id_ << "_locals_data(const __resumable_lambda_" << lambda_id_ << "_locals_data&) = delete;\n";
     before << "    __resumable_lambda_" << lambda_id_ << "_locals_data(__resumable_lambda_" << lambda_id_ << "_locals_data&&) = delete;\n";
     before << "    __resumable_lambda_" << lambda_id_ << "_locals_data& operator=(__resumable_lambda_" << lambda_id_ << "_locals_data&&) = delete;\n";
     before << "    __resumable_lambda_" << lambda_id_ << "_locals_data& operator=(const __resumable_lambda_" << lambda_id_ << "_locals_data&) = delete;\n";
-    before << "    ~__resumable_lambda_" << lambda_id_ << "_locals_data() {}\n";
+    if (!IsConstexpr())
+      before << "    ~__resumable_lambda_" << lambda_id_ << "_locals_data() {}\n";
     before << "\n";
     EmitLocalsDataMembers(before);
     before << "\n";
     EmitLocalsDataUnwindTo(before);
     before << "  };\n";
     before << "\n";
-    before << "  struct __resumable_lambda_" << lambda_id_ << "_locals_unwinder\n";
-    before << "  {\n";
-    before << "    __resumable_lambda_" << lambda_id_ << "_locals_data* __locals;\n";
-    before << "\n";
-    before << "    ~__resumable_lambda_" << lambda_id_ << "_locals_unwinder()\n";
-    before << "    {\n";
-    before << "      if (this->__locals)\n";
-    before << "        this->__locals->__unwind_to(-1);\n";
-    before << "    }\n";
-    before << "  };\n";
-    before << "\n";
     before << "  struct __resumable_lambda_" << lambda_id_ << "_locals :\n";
     before << "    __resumable_lambda_" << lambda_id_ << "_locals_data\n";
     before << "  {\n";
@@ -808,8 +1024,8 @@ public:
     before << "\n";
     before << "  struct __resumable_lambda_" << lambda_id_ << "_initializer\n";
     before << "  {\n";
-    before << "    typedef __resumable_lambda_" << lambda_id_ << " lambda __RESUMABLE_UNUSED_TYPEDEF;\n";
-    before << "    typedef __resumable_lambda_" << lambda_id_ << "_in_place generator_type __RESUMABLE_UNUSED_TYPEDEF;\n";
+    before << "    typedef " << GenericType("__resumable_lambda_" + std::to_string(lambda_id_)) << " lambda __RESUMABLE_UNUSED_TYPEDEF;\n";
+    before << "    typedef " << GenericType("__resumable_lambda_" + std::to_string(lambda_id_) + "_in_place") << " generator_type __RESUMABLE_UNUSED_TYPEDEF;\n";
     before << "    __resumable_lambda_" << lambda_id_ << "_capture __capture;\n";
     before << "  };\n";
     before << "\n";
@@ -824,21 +1040,51 @@ public:
     before << "      return { static_cast<__resumable_lambda_" << lambda_id_ << "_capture&&>(*this) };\n";
     before << "    }\n";
     before << "\n";
-    before << "    bool is_initial() const noexcept { return this->__state == 0; }\n";
-    before << "    bool is_terminal() const noexcept { return this->__state == -1; }\n";
+    EmitRelocatable(before);
+    before << "\n";
+    EmitReset(before);
+    before << "\n";
+    before << "    " << Constexpr() << "int state() const noexcept { return this->__state; }\n";
+    before << "    " << Constexpr() << "bool is_initial() const noexcept { return this->__state == 0; }\n";
+    EmitIsTerminal(before);
+    EmitIsPreempted(before);
     before << "\n";
     EmitWantedType(before);
     before << "\n";
     EmitWanted(before);
     before << "\n";
+    EmitDelegate(before);
+    before << "\n";
+    if (IsBatched())
+      before << "    __resumable_batch __batch;\n\n";
     EmitCallOperatorDecl(before);
     before << "    {\n";
-    before << "      __resumable_lambda_" << lambda_id_ << "_locals_unwinder __unwind = { this };\n";
-    before << "      switch (this->__state)\n";
-    before << "      {\n";
-    before << "      case 0:\n";
-    before << "        this->__state = 1;\n";
-    before << "      case 1:\n";
+    if (IsConstexpr())
+    {
+      // Every suspension stores its own state, so any other way out of the
+      // body, including a plain return, leaves the frame terminated.
+      before << "      __resumable_constexpr_unwinder __unwind{};\n";
+      before << "      int __resume = this->__state;\n";
+      before << "      this->__state = -1;\n";
+      before << "      switch (__resume)\n";
+      before << "      {\n";
+      before << "      case 0:\n";
+      before << "      case 1:\n";
+    }
+    else
+    {
+      // A plain return relies on the unwinder to destroy the live locals, so
+      // it must stay armed even when exceptions are disabled.
+      before << "      __resumable_locals_unwinder<__resumable_lambda_" << lambda_id_ << "_locals_data";
+      if (locals_.hasPlainReturn())
+        before << ", true";
+      before << "> __unwind(this);\n";
+      before << "      switch (this->__state)\n";
+      before << "      {\n";
+      before << "      case 0:\n";
+      before << "        this->__state = 1;\n";
+      before << "      case 1:\n";
+    }
     EmitLineNumber(before, body->getLocStart());
     rewriter_.ReplaceText(beforeBody, before.str());
 
@@ -850,6 +1096,11 @@ public:
     after << "      default: (void)0;\n";
     after << "      }\n";
     after << "    }\n";
+    if (IsGeneric())
+    {
+      after << "    ;\n";
+      after << "    }\n";
+    }
     after << "  };\n";
     after << "\n";
     EmitInPlaceGenerator(after);
@@ -870,6 +1121,25 @@ public:
       rewriter_.InsertTextBefore(stmt->getLocStart(), "{");
     }
 
+    int preemption_id = locals_.getPreemptionId(stmt);
+    if (preemption_id > 0 && CanPreempt())
+    {
+      std::stringstream os;
+      os << "\n";
+      os << "        if (__resumable_preempt())\n";
+      os << "        {\n";
+      os << "          this->__state = " << preemption_id << ";\n";
+      os << "          __unwind.__release();\n";
+      if (locals_.hasVoidReturn() || lambda_expr_->getCallOperator()->getReturnType()->isVoidType())
+        os << "          return;\n";
+      else
+        os << "          return {};\n";
+      os << "        case " << preemption_id << ":\n";
+      os << "          (void)0;\n";
+      os << "        }\n";
+      rewriter_.InsertTextAfterToken(stmt->getLBracLoc(), os.str());
+    }
+
     for (CompoundStmt::body_iterator b = stmt->body_begin(), e = stmt->body_end(); b != e; ++b)
     {
       if (BinaryOperator* bin_op = dyn_cast<BinaryOperator>(*b))
@@ -906,9 +1176,8 @@ public:
               EmitLineNumber(os, after_from->getLocStart());
               os << "              auto& __g = " << expr.substr(0, expr.length() - 1) << ";\n";
               os << "              if (__g.is_terminal()) break;\n";
-              os << "              __unwind.__locals = nullptr;\n";
-              os << "              __resumable_generator_invoke<decltype(__g), decltype(__g())> __ret(__g);\n";
-              os << "              " << rewriter_.getRewrittenText(target_range) << " __ret.__get();\n";
+              os << "              __unwind.__release();\n";
+              os << "              " << rewriter_.getRewrittenText(target_range) << " __g();\n";
               os << "              return;\n";
               os << "            }\n";
               if (dyn_cast<MaterializeTemporaryExpr>(after_from))
@@ -936,6 +1205,7 @@ public:
       TraverseStmt(*b);
     }
 
+
     if (stmt != lambda_expr_->getBody())
     {
       std::string unwind = "this->__unwind_to(" + std::to_string(locals_.getYieldId(stmt)) + ");}";
@@ -1000,9 +1270,9 @@ public:
         EmitLineNumber(os, after_from->getLocStart());
         os << "              auto& __g = " << expr.substr(0, expr.length() - 1) << ";\n";
         os << "              if (__g.is_terminal()) break;\n";
-        os << "              __unwind.__locals = nullptr;\n";
-        os << "              __resumable_generator_invoke<decltype(__g), decltype(__g())> __ret(__g);\n";
-        os << "              return __ret.__get();\n";
+        EmitConstexprState(os, yield_point);
+        os << "              __unwind.__release();\n";
+        os << "              return __g();\n";
         os << "            }\n";
         if (dyn_cast<MaterializeTemporaryExpr>(after_from))
           os << "          case " << yield_point - 1 << ":\n";
@@ -1033,7 +1303,21 @@ public:
         os << "        do\n";
         os << "        {\n";
         os << "          this->__state = " << yield_point << ";\n";
-        os << "          __unwind.__locals = nullptr;\n";
+        if (IsBatched())
+        {
+          // While resume_n() has room in its buffer, store the value and
+          // carry on rather than returning.
+          os << "          if (this->__batch.__room)\n";
+          os << "          {\n";
+          EmitLineNumber(os, after_yield->getLocStart());
+          os << "            __resumable_batch_put";
+          if (lambda_expr_->hasExplicitResultType())
+            os << "<" << lambda_expr_->getCallOperator()->getReturnType().getAsString() << ">";
+          os << "(this->__batch, " << expr.substr(0, expr.length() - 1) << ");\n";
+          os << "            break;\n";
+          os << "          }\n";
+        }
+        os << "          __unwind.__release();\n";
         EmitLineNumber(os, after_yield->getLocStart());
         os << "          return " << expr.substr(0, expr.length() - 1) << ";\n";
         os << "        case " << yield_point << ":\n";
@@ -1075,11 +1359,22 @@ public:
       os << "          {\n";
       os << "            {\n";
       os << "              auto& __g = " << expr.substr(0, expr.length() - 1) << ";\n";
-      os << "              __unwind.__locals = nullptr;\n";
-      os << "              __resumable_generator_invoke<decltype(__g), decltype(__g())> __ret(__g);\n";
-      os << "              if (__g.is_terminal())\n";
-      os << "                this->__state = -1;\n";
-      os << "              return __ret.__get();\n";
+      EmitConstexprState(os, yield_point);
+      os << "              __unwind.__release();\n";
+      // The result is built once, straight from the sub-generator. A guard
+      // then finishes the frame, unwinding its locals, once the
+      // sub-generator has returned its last value. A constexpr frame cannot
+      // hold a guard with a destructor, and has no locals to unwind, so it
+      // passes the result through a literal wrapper that sets the state.
+      if (IsConstexpr())
+      {
+        os << "              return __resumable_constexpr_return_from<decltype(__g)>(__g, this->__state).__get();\n";
+      }
+      else
+      {
+        os << "              __resumable_return_from_guard<decltype(__g), __resumable_lambda_" << lambda_id_ << "_locals_data> __finish{__g, this};\n";
+        os << "              return __g();\n";
+      }
       os << "            }\n";
       if (dyn_cast<MaterializeTemporaryExpr>(after_from))
         os << "          case " << yield_point - 1 << ":\n";
@@ -1100,6 +1395,63 @@ public:
   }
 
 private:
+  // With -c, a lambda whose frame holds no locals is emitted as a literal
+  // type with constexpr constructors and call operator. Locals are excluded
+  // because they live in a union whose active member cannot change during
+  // constant evaluation.
+  bool IsConstexpr()
+  {
+    if (!constexpr_lambdas || locals_.begin() != locals_.end())
+      return false;
+    if (IsBatched() || IsGeneric())
+      return false;
+    return !(locals_.hasPreemptionPoints() && CanPreempt());
+  }
+
+  std::string Constexpr()
+  {
+    return IsConstexpr() ? "constexpr " : "";
+  }
+
+  // A constexpr call operator marks the frame terminated on entry, so a
+  // "yield from" or "return from" stores its state again each time it hands
+  // back a value from the generator it delegates to.
+  void EmitConstexprState(std::ostream& os, int yield_point)
+  {
+    if (IsConstexpr())
+      os << "              this->__state = " << yield_point << ";\n";
+  }
+
+  bool IsGeneric()
+  {
+    return lambda_expr_->isGenericLambda();
+  }
+
+  std::string GenericType(const std::string& type)
+  {
+    return IsGeneric() ? "__resumable_generic<" + type + ">" : type;
+  }
+
+  // A preempted resume has to return something, so preemption points are
+  // only emitted when the result type can be named and default constructed.
+  bool CanPreempt()
+  {
+    if (IsBatched())
+      return false;
+    if (lambda_expr_->hasExplicitResultType())
+      return !lambda_expr_->getCallOperator()->getReturnType()->isReferenceType();
+    return locals_.hasVoidReturn();
+  }
+
+  bool IsBatched()
+  {
+    if (!batch_yields || locals_.hasVoidReturn())
+      return false;
+    if (lambda_expr_->hasExplicitResultType())
+      return !lambda_expr_->getCallOperator()->getReturnType()->isVoidType();
+    return true;
+  }
+
   void EmitCaptureTypedefs(std::ostream& os)
   {
     for (LambdaExpr::capture_iterator c = lambda_expr_->capture_begin(), e = lambda_expr_->capture_end(); c != e; ++c)
@@ -1130,7 +1482,7 @@ private:
 
   void EmitCaptureConstructor(std::ostream& os)
   {
-    os << "    explicit __resumable_lambda_" << lambda_id_ << "_capture(__resumable_dummy_arg";
+    os << "    " << Constexpr() << "explicit __resumable_lambda_" << lambda_id_ << "_capture(__resumable_dummy_arg";
     for (LambdaExpr::capture_iterator c = lambda_expr_->capture_begin(), e = lambda_expr_->capture_end(); c != e; ++c)
     {
       os << ",\n";
@@ -1239,7 +1591,7 @@ private:
 
   void EmitLocalsDataUnwindTo(std::ostream& os)
   {
-    os << "    void __unwind_to(int __new_state)\n";
+    os << "    " << Constexpr() << "void __unwind_to(int __new_state)\n";
     os << "    {\n";
     os << "      while (this->__state > __new_state)\n";
     os << "      {\n";
@@ -1287,7 +1639,7 @@ private:
 
   void EmitLocalsConstructor(std::ostream& os)
   {
-    os << "    __resumable_lambda_" << lambda_id_ << "_locals()\n";
+    os << "    " << Constexpr() << "__resumable_lambda_" << lambda_id_ << "_locals()\n";
     os << "    {\n";
     os << "      this->__state = 0;\n";
     os << "    }\n";
@@ -1295,6 +1647,16 @@ private:
 
   void EmitLocalsCopyConstructor(std::ostream& os)
   {
+    if (IsConstexpr())
+    {
+      os << "    constexpr __resumable_lambda_" << lambda_id_ << "_locals(const __resumable_lambda_" << lambda_id_ << "_locals& __other) :\n";
+      os << "      __resumable_lambda_" << lambda_id_ << "_locals_data()\n";
+      os << "    {\n";
+      os << "      this->__state = __other.__state;\n";
+      os << "    }\n";
+      return;
+    }
+
     os << "    enum { __is_copy_constructible_v =\n";
     for (resumable_lambda_locals::iterator v = locals_.begin(), e = locals_.end(); v != e; ++v)
       os << "      ::std::is_copy_constructible<decltype(" << v->second.full_name << ")>::value &&\n";
@@ -1311,7 +1673,7 @@ private:
     os << "    __resumable_lambda_" << lambda_id_ << "_locals(const __copy_constructor_arg& __other) :\n";
     os << "      __resumable_lambda_" << lambda_id_ << "_locals_data()\n";
     os << "    {\n";
-    os << "      __resumable_lambda_" << lambda_id_ << "_locals_unwinder __unwind = { this };\n";
+    os << "      __resumable_locals_unwinder<__resumable_lambda_" << lambda_id_ << "_locals_data> __unwind(this);\n";
     for (resumable_lambda_locals::iterator v = locals_.begin(), e = locals_.end(); v != e; ++v)
     {
       std::string name = v->second.full_name;
@@ -1330,12 +1692,23 @@ private:
       os << "      }\n";
     }
     os << "      this->__state = __other.__state;\n";
-    os << "      __unwind.__locals = nullptr;\n";
+    os << "      __unwind.__release();\n";
     os << "    }\n";
   }
 
   void EmitLocalsMoveConstructor(std::ostream& os)
   {
+    if (IsConstexpr())
+    {
+      os << "    constexpr __resumable_lambda_" << lambda_id_ << "_locals(__resumable_lambda_" << lambda_id_ << "_locals&& __other) :\n";
+      os << "      __resumable_lambda_" << lambda_id_ << "_locals_data()\n";
+      os << "    {\n";
+      os << "      this->__state = __other.__state;\n";
+      os << "      __other.__state = -1;\n";
+      os << "    }\n";
+      return;
+    }
+
     os << "    enum { __is_move_constructible_v =\n";
     for (resumable_lambda_locals::iterator v = locals_.begin(), e = locals_.end(); v != e; ++v)
       os << "      ::std::is_move_constructible<decltype(" << v->second.full_name << ")>::value &&\n";
@@ -1352,8 +1725,7 @@ private:
     os << "    __resumable_lambda_" << lambda_id_ << "_locals(__move_constructor_arg&& __other) :\n";
     os << "      __resumable_lambda_" << lambda_id_ << "_locals_data()\n";
     os << "    {\n";
-    os << "      __resumable_lambda_" << lambda_id_ << "_locals_unwinder __unwind = { this };\n";
-    os << "      __resumable_lambda_" << lambda_id_ << "_locals_unwinder __unwind_other = { &__other };\n";
+    os << "      __resumable_locals_unwinder<__resumable_lambda_" << lambda_id_ << "_locals_data> __unwind(this);\n";
     for (resumable_lambda_locals::iterator v = locals_.begin(), e = locals_.end(); v != e; ++v)
     {
       std::string name = v->second.full_name;
@@ -1372,12 +1744,18 @@ private:
       os << "      }\n";
     }
     os << "      this->__state = __other.__state;\n";
-    os << "      __unwind.__locals = nullptr;\n";
+    os << "      __unwind.__release();\n";
+    os << "      __other.__unwind_to(-1);\n";
     os << "    }\n";
   }
 
   void EmitLocalsDestructor(std::ostream& os)
   {
+    // With no locals there is nothing to unwind, and a trivial destructor
+    // keeps the frame a literal type.
+    if (IsConstexpr())
+      return;
+
     os << "    ~__resumable_lambda_" << lambda_id_ << "_locals()\n";
     os << "    {\n";
     os << "      this->__unwind_to(-1);\n";
@@ -1386,7 +1764,7 @@ private:
 
   void EmitConstructor(std::ostream& os)
   {
-    os << "    __resumable_lambda_" << lambda_id_ << "(__resumable_dummy_arg";
+    os << "    " << Constexpr() << "__resumable_lambda_" << lambda_id_ << "(__resumable_dummy_arg";
     for (LambdaExpr::capture_iterator c = lambda_expr_->capture_begin(), e = lambda_expr_->capture_end(); c != e; ++c)
     {
       os << ",\n";
@@ -1440,10 +1818,129 @@ private:
     os << "    }\n";
   }
 
+  void EmitCaptureParameters(std::ostream& os)
+  {
+    for (LambdaExpr::capture_iterator c = lambda_expr_->capture_begin(), e = lambda_expr_->capture_end(); c != e; ++c)
+    {
+      os << (c == lambda_expr_->capture_begin() ? "\n" : ",\n");
+      if (c->getCaptureKind() == LCK_This)
+      {
+        os << "        __resumable_lambda_" << lambda_id_ << "_this_type __capture_arg_this";
+      }
+      else if (c->isInitCapture())
+      {
+        std::string name = c->getCapturedVar()->getDeclName().getAsString();
+        os << "        __resumable_lambda_" << lambda_id_ << "_" << name << "_type&& __capture_arg_" << name;
+      }
+      else if (c->getCaptureKind() == LCK_ByRef)
+      {
+        std::string name = c->getCapturedVar()->getDeclName().getAsString();
+        os << "        __resumable_lambda_" << lambda_id_ << "_" << name << "_type& __capture_arg_" << name;
+      }
+      else
+      {
+        std::string name = c->getCapturedVar()->getDeclName().getAsString();
+        os << "        const __resumable_lambda_" << lambda_id_ << "_" << name << "_type& __capture_arg_" << name;
+      }
+    }
+  }
+
+  void EmitCaptureArguments(std::ostream& os)
+  {
+    for (LambdaExpr::capture_iterator c = lambda_expr_->capture_begin(), e = lambda_expr_->capture_end(); c != e; ++c)
+    {
+      os << ",\n";
+      if (c->getCaptureKind() == LCK_This)
+        os << "          __capture_arg_this";
+      else if (c->isInitCapture())
+      {
+        std::string name = c->getCapturedVar()->getDeclName().getAsString();
+        os << "          static_cast<__resumable_lambda_" << lambda_id_ << "_" << name << "_type&&>(__capture_arg_" << name << ")";
+      }
+      else
+      {
+        std::string name = c->getCapturedVar()->getDeclName().getAsString();
+        os << "          __capture_arg_" << name;
+      }
+    }
+  }
+
+  void EmitReset(std::ostream& os)
+  {
+    // Returning to the initial state lets a finished frame be reused without
+    // reallocating it. rebind() also replaces the captures. The new ones are
+    // built first, so a throwing capture constructor leaves the frame as it
+    // was. Captures by reference cannot be assigned, so the old captures are
+    // then destroyed and the new ones moved into their place. That move must
+    // not throw, which the free rebind() checks at compile time.
+    os << "    enum { __is_nothrow_rebindable_v =\n";
+    os << "      ::std::is_nothrow_move_constructible<__resumable_lambda_" << lambda_id_ << "_capture>::value };\n";
+    os << "\n";
+    os << "    void reset() noexcept\n";
+    os << "    {\n";
+    os << "      this->__unwind_to(-1);\n";
+    os << "      this->__state = 0;\n";
+    os << "    }\n";
+    os << "\n";
+    os << "    void rebind(";
+    EmitCaptureParameters(os);
+    os << ")\n";
+    os << "    {\n";
+    os << "      __resumable_lambda_" << lambda_id_ << "_capture __capture(__resumable_dummy_arg()";
+    EmitCaptureArguments(os);
+    os << ");\n";
+    os << "      this->reset();\n";
+    os << "      __resumable_replace_capture(static_cast<__resumable_lambda_" << lambda_id_ << "_capture*>(this), __capture);\n";
+    os << "    }\n";
+  }
+
+  void EmitRelocatable(std::ostream& os)
+  {
+    // A frame may be moved with memcpy when its captures and all of its
+    // locals may be. Like the copy constructor, this assumes that no local
+    // points into the frame itself.
+    os << "    enum { __is_trivially_relocatable_v =\n";
+    os << "      ::std::is_trivially_copyable<__resumable_lambda_" << lambda_id_ << "_capture>::value &&\n";
+    for (resumable_lambda_locals::iterator v = locals_.begin(), e = locals_.end(); v != e; ++v)
+      os << "      ::std::is_trivially_copyable<decltype(" << v->second.full_name << ")>::value &&\n";
+    os << "      true };\n";
+  }
+
   void EmitCallOperatorDecl(std::ostream& os)
   {
     CXXMethodDecl* method = lambda_expr_->getCallOperator();
+    if (IsGeneric())
+    {
+      // A local class cannot have a member template, so the body of a
+      // generic lambda goes into a generic lambda of its own. The wrapper
+      // __resumable_generic supplies the templated call operator.
+      os << "    auto __call_operator() noexcept\n";
+      os << "    {\n";
+      os << "      return [this](";
+      for (FunctionDecl::param_iterator p = method->param_begin(), e = method->param_end(); p != e; ++p)
+      {
+        if (p != method->param_begin())
+          os << ",";
+        os << "\n        " << rewriter_.getRewrittenText((*p)->getSourceRange());
+      }
+      os << ")";
+      if (lambda_expr_->hasExplicitResultType() && !method->getReturnType()->isDependentType())
+        os << " -> " << method->getReturnType().getAsString();
+      else if (locals_.hasVoidReturn())
+        os << " -> void";
+      os << "\n";
+      return;
+    }
+
     os << "    ";
+    // When a "yield from" operand is itself a resumable lambda, its type is
+    // known here, so with -i the compiler is asked to inline its call
+    // operator into ours. This is only a hint: the child keeps its own
+    // frame and its own switch, which the optimiser may or may not merge
+    // with ours.
+    if (inline_generators && locals_.hasLambdaGenerator())
+      os << "__RESUMABLE_FLATTEN ";
+    os << Constexpr();
     if (lambda_expr_->hasExplicitResultType())
       os << method->getReturnType().getAsString();
     else if (locals_.hasVoidReturn())
@@ -1460,30 +1957,64 @@ private:
     os << ")\n";
   }
 
-  void EmitWantedType(std::ostream& os)
+  void EmitIsPreempted(std::ostream& os)
   {
-    os << "    const std::type_info& wanted_type() const noexcept\n";
+    if (!locals_.hasPreemptionPoints() || !CanPreempt())
+    {
+      os << "    bool is_preempted() const noexcept { return false; }\n";
+      return;
+    }
+
+    os << "    bool is_preempted() const noexcept\n";
+    os << "    {\n";
+    os << "      switch (this->__state)\n";
+    os << "      {\n";
+    for (auto p = locals_.preemption_begin(), e = locals_.preemption_end(); p != e; ++p)
+      os << "      case " << p->second << ":\n";
+    os << "        return true;\n";
+    os << "      default:\n";
+    os << "        return false;\n";
+    os << "      }\n";
+    os << "    }\n";
+  }
+
+  void EmitIsTerminal(std::ostream& os)
+  {
+    if (!locals_.hasReturnFrom())
+    {
+      os << "    " << Constexpr() << "bool is_terminal() const noexcept { return this->__state == -1; }\n";
+      return;
+    }
+
+    // Resuming the frame finishes it along with its "return from"
+    // sub-generator. A consumer that resumes the sub-generator directly,
+    // through delegate(), leaves the frame in the "return from" state, so
+    // the sub-generator is asked as well.
+    os << "    " << Constexpr() << "bool is_terminal() const noexcept\n";
     os << "    {\n";
     os << "      switch (this->__state)\n";
     os << "      {\n";
+    os << "      case -1:\n";
+    os << "        return true;\n";
     for (int yield_id = 0; yield_id <= locals_.getLastYieldId(); ++yield_id)
     {
       std::string subgen = locals_.getSubGenerator(yield_id);
-      if (!subgen.empty())
+      if (!subgen.empty() && locals_.isReturnFrom(yield_id))
       {
         os << "      case " << yield_id << ":\n";
-        os << "        return (" + subgen + ").wanted_type();\n";
+        os << "        return (" + subgen + ").is_terminal();\n";
       }
     }
     os << "      default:\n";
-    os << "        return typeid(void);\n";
+    os << "        return false;\n";
     os << "      }\n";
     os << "    }\n";
   }
 
-  void EmitWanted(std::ostream& os)
+  void EmitWantedType(std::ostream& os)
   {
-    os << "    void* wanted() noexcept\n";
+    os << "#if __RESUMABLE_RTTI\n";
+    os << "    const std::type_info& wanted_type() const noexcept\n";
     os << "    {\n";
     os << "      switch (this->__state)\n";
     os << "      {\n";
@@ -1493,11 +2024,33 @@ private:
       if (!subgen.empty())
       {
         os << "      case " << yield_id << ":\n";
-        os << "        return (" + subgen + ").wanted();\n";
+        os << "        return (" + subgen + ").wanted_type();\n";
       }
     }
     os << "      default:\n";
-    os << "        return nullptr;\n";
+    os << "        return typeid(void);\n";
+    os << "      }\n";
+    os << "    }\n";
+    os << "#endif // __RESUMABLE_RTTI\n";
+  }
+
+  void EmitWanted(std::ostream& os)
+  {
+    os << "    void* wanted() noexcept\n";
+    os << "    {\n";
+    os << "      switch (this->__state)\n";
+    os << "      {\n";
+    for (int yield_id = 0; yield_id <= locals_.getLastYieldId(); ++yield_id)
+    {
+      std::string subgen = locals_.getSubGenerator(yield_id);
+      if (!subgen.empty())
+      {
+        os << "      case " << yield_id << ":\n";
+        os << "        return (" + subgen + ").wanted();\n";
+      }
+    }
+    os << "      default:\n";
+    os << "        return nullptr;\n";
     os << "      }\n";
     os << "    }\n";
     os << "\n";
@@ -1518,6 +2071,45 @@ private:
     os << "        return nullptr;\n";
     os << "      }\n";
     os << "    }\n";
+    os << "\n";
+    os << "    void* wanted(__resumable_type_id __id) noexcept\n";
+    os << "    {\n";
+    os << "      switch (this->__state)\n";
+    os << "      {\n";
+    for (int yield_id = 0; yield_id <= locals_.getLastYieldId(); ++yield_id)
+    {
+      std::string subgen = locals_.getSubGenerator(yield_id);
+      if (!subgen.empty())
+      {
+        os << "      case " << yield_id << ":\n";
+        os << "        return __resumable_wanted(" + subgen + ", __id);\n";
+      }
+    }
+    os << "      default:\n";
+    os << "        return nullptr;\n";
+    os << "      }\n";
+    os << "    }\n";
+  }
+
+  void EmitDelegate(std::ostream& os)
+  {
+    os << "    void* delegate(__resumable_type_id __id) noexcept\n";
+    os << "    {\n";
+    os << "      switch (this->__state)\n";
+    os << "      {\n";
+    for (int yield_id = 0; yield_id <= locals_.getLastYieldId(); ++yield_id)
+    {
+      std::string subgen = locals_.getSubGenerator(yield_id);
+      if (!subgen.empty())
+      {
+        os << "      case " << yield_id << ":\n";
+        os << "        return __resumable_delegate(" + subgen + ", __id);\n";
+      }
+    }
+    os << "      default:\n";
+    os << "        return nullptr;\n";
+    os << "      }\n";
+    os << "    }\n";
   }
 
   void EmitInPlaceGenerator(std::ostream& os)
@@ -1542,13 +2134,45 @@ private:
     os << "      this->__lambda.~__resumable_lambda_" << lambda_id_ << "();\n";
     os << "    }\n";
     os << "\n";
+    os << "    int state() const noexcept { return this->__lambda.state(); }\n";
     os << "    bool is_initial() const noexcept { return this->__lambda.is_initial(); }\n";
     os << "    bool is_terminal() const noexcept { return this->__lambda.is_terminal(); }\n";
+    os << "    bool is_preempted() const noexcept { return this->__lambda.is_preempted(); }\n";
+    os << "\n";
+    os << "    void reset() noexcept { this->__lambda.reset(); }\n";
+    os << "\n";
+    os << "    enum { __is_nothrow_rebindable_v = __resumable_lambda_" << lambda_id_ << "::__is_nothrow_rebindable_v };\n";
+    os << "\n";
+    os << "    void rebind(";
+    EmitCaptureParameters(os);
+    os << ")\n";
+    os << "    {\n";
+    os << "      this->__lambda.rebind(";
+    for (LambdaExpr::capture_iterator c = lambda_expr_->capture_begin(), e = lambda_expr_->capture_end(); c != e; ++c)
+    {
+      os << (c == lambda_expr_->capture_begin() ? "\n" : ",\n");
+      if (c->getCaptureKind() == LCK_This)
+        os << "          __capture_arg_this";
+      else if (c->isInitCapture())
+      {
+        std::string name = c->getCapturedVar()->getDeclName().getAsString();
+        os << "          static_cast<__resumable_lambda_" << lambda_id_ << "_" << name << "_type&&>(__capture_arg_" << name << ")";
+      }
+      else
+      {
+        std::string name = c->getCapturedVar()->getDeclName().getAsString();
+        os << "          __capture_arg_" << name;
+      }
+    }
+    os << ");\n";
+    os << "    }\n";
     os << "\n";
+    os << "#if __RESUMABLE_RTTI\n";
     os << "    const std::type_info& wanted_type() const noexcept\n";
     os << "    {\n";
     os << "      return this->__lambda.wanted_type();\n";
     os << "    }\n";
+    os << "#endif // __RESUMABLE_RTTI\n";
     os << "\n";
     os << "    void* wanted() noexcept\n";
     os << "    {\n";
@@ -1560,6 +2184,27 @@ private:
     os << "      return this->__lambda.wanted();\n";
     os << "    }\n";
     os << "\n";
+    os << "    void* wanted(__resumable_type_id __id) noexcept\n";
+    os << "    {\n";
+    os << "      return this->__lambda.wanted(__id);\n";
+    os << "    }\n";
+    os << "\n";
+    os << "    void* delegate(__resumable_type_id __id) noexcept\n";
+    os << "    {\n";
+    os << "      return this->__lambda.delegate(__id);\n";
+    os << "    }\n";
+    os << "\n";
+    if (IsGeneric())
+    {
+      os << "    auto __call_operator() noexcept\n";
+      os << "    {\n";
+      os << "      return this->__lambda.__call_operator();\n";
+      os << "    }\n";
+      os << "    union { __resumable_lambda_" << lambda_id_ << " __lambda; };\n";
+      os << "  };\n";
+      return;
+    }
+
     CXXMethodDecl* method = lambda_expr_->getCallOperator();
     os << "    ";
     if (lambda_expr_->hasExplicitResultType())
@@ -1594,7 +2239,7 @@ private:
   {
     os << "  struct __resumable_lambda_" << lambda_id_ << "_factory\n";
     os << "  {\n";
-    os << "    __resumable_lambda_" << lambda_id_ << " operator()(__resumable_dummy_arg";
+    os << "    " << Constexpr() << GenericType("__resumable_lambda_" + std::to_string(lambda_id_)) << " operator()(__resumable_dummy_arg";
     for (LambdaExpr::capture_iterator c = lambda_expr_->capture_begin(), e = lambda_expr_->capture_end(); c != e; ++c)
     {
       os << ",\n";
@@ -1770,6 +2415,7 @@ public:
     std::string preamble = "#ifndef __RESUMABLE_PREAMBLE\n";
     preamble += "#define __RESUMABLE_PREAMBLE\n";
     preamble += "\n";
+    preamble += "#include <cstddef>\n";
     preamble += "#include <new>\n";
     preamble += "#include <typeinfo>\n";
     preamble += "#include <type_traits>\n";
@@ -1783,8 +2429,117 @@ public:
     preamble += "# define __RESUMABLE_UNUSED_TYPEDEF\n";
     preamble += "#endif\n";
     preamble += "\n";
+    preamble += "#if defined(__clang__)\n";
+    preamble += "# if defined(__has_attribute)\n";
+    preamble += "#  if __has_attribute(__flatten__)\n";
+    preamble += "#   define __RESUMABLE_FLATTEN __attribute__((__flatten__))\n";
+    preamble += "#  endif\n";
+    preamble += "# endif\n";
+    preamble += "#elif defined(__GNUC__)\n";
+    preamble += "# define __RESUMABLE_FLATTEN __attribute__((__flatten__))\n";
+    preamble += "#endif\n";
+    preamble += "#ifndef __RESUMABLE_FLATTEN\n";
+    preamble += "# define __RESUMABLE_FLATTEN\n";
+    preamble += "#endif\n";
+    preamble += "\n";
+    preamble += "#if defined(__GXX_RTTI) || defined(_CPPRTTI) || defined(__cpp_rtti)\n";
+    preamble += "# define __RESUMABLE_RTTI 1\n";
+    preamble += "#else\n";
+    preamble += "# define __RESUMABLE_RTTI 0\n";
+    preamble += "#endif\n";
+    preamble += "\n";
+    preamble += "#ifndef __RESUMABLE_EXCEPTIONS\n";
+    preamble += "# if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)\n";
+    preamble += "#  define __RESUMABLE_EXCEPTIONS 1\n";
+    preamble += "# else\n";
+    preamble += "#  define __RESUMABLE_EXCEPTIONS 0\n";
+    preamble += "# endif\n";
+    preamble += "#endif\n";
+    preamble += "\n";
     preamble += "struct __resumable_dummy_arg {};\n";
     preamble += "\n";
+    // Rebuilds a frame's captures in place for rebind(). Being noexcept, a
+    // throwing move ends the program rather than leaving the frame without
+    // its captures.
+    preamble += "template <class _Capture>\n";
+    preamble += "inline void __resumable_replace_capture(_Capture* __old, _Capture& __new) noexcept\n";
+    preamble += "{\n";
+    preamble += "  __old->~_Capture();\n";
+    preamble += "  ::new (static_cast<void*>(__old)) _Capture(static_cast<_Capture&&>(__new));\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "struct __resumable_constexpr_unwinder\n";
+    preamble += "{\n";
+    preamble += "  constexpr void __release() const noexcept {}\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "template <class _Locals, bool _OnReturn = false>\n";
+    preamble += "struct __resumable_locals_unwinder\n";
+    preamble += "{\n";
+    preamble += "  explicit __resumable_locals_unwinder(_Locals* __l) noexcept\n";
+    preamble += "    : __locals(__l) {}\n";
+    preamble += "\n";
+    preamble += "  ~__resumable_locals_unwinder()\n";
+    preamble += "  {\n";
+    preamble += "    if (__locals)\n";
+    preamble += "      __locals->__unwind_to(-1);\n";
+    preamble += "  }\n";
+    preamble += "\n";
+    preamble += "  void __release() noexcept { __locals = nullptr; }\n";
+    preamble += "\n";
+    preamble += "  _Locals* __locals;\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "#if !__RESUMABLE_EXCEPTIONS\n";
+    preamble += "template <class _Locals>\n";
+    preamble += "struct __resumable_locals_unwinder<_Locals, false>\n";
+    preamble += "{\n";
+    preamble += "  explicit __resumable_locals_unwinder(_Locals*) noexcept {}\n";
+    preamble += "  void __release() noexcept {}\n";
+    preamble += "};\n";
+    preamble += "#endif // !__RESUMABLE_EXCEPTIONS\n";
+    preamble += "\n";
+    preamble += "template <class _G, class _Locals>\n";
+    preamble += "struct __resumable_return_from_guard\n";
+    preamble += "{\n";
+    preamble += "  ~__resumable_return_from_guard()\n";
+    preamble += "  {\n";
+    preamble += "    if (__g.is_terminal())\n";
+    preamble += "      __locals->__unwind_to(-1);\n";
+    preamble += "  }\n";
+    preamble += "\n";
+    preamble += "  _G& __g;\n";
+    preamble += "  _Locals* __locals;\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "template <class _G, class _Result = decltype(::std::declval<_G&>()())>\n";
+    preamble += "struct __resumable_constexpr_return_from\n";
+    preamble += "{\n";
+    preamble += "  constexpr __resumable_constexpr_return_from(_G& __g, int& __state)\n";
+    preamble += "    : __result(__g())\n";
+    preamble += "  {\n";
+    preamble += "    if (__g.is_terminal())\n";
+    preamble += "      __state = -1;\n";
+    preamble += "  }\n";
+    preamble += "\n";
+    preamble += "  constexpr _Result __get() { return static_cast<_Result&&>(__result); }\n";
+    preamble += "\n";
+    preamble += "  _Result __result;\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "template <class _G>\n";
+    preamble += "struct __resumable_constexpr_return_from<_G, void>\n";
+    preamble += "{\n";
+    preamble += "  constexpr __resumable_constexpr_return_from(_G& __g, int& __state)\n";
+    preamble += "  {\n";
+    preamble += "    __g();\n";
+    preamble += "    if (__g.is_terminal())\n";
+    preamble += "      __state = -1;\n";
+    preamble += "  }\n";
+    preamble += "\n";
+    preamble += "  constexpr void __get() const noexcept {}\n";
+    preamble += "};\n";
+    preamble += "\n";
     preamble += "template <class _T>\n";
     preamble += "struct __resumable_copy_disabled : _T {};\n";
     preamble += "\n";
@@ -1800,6 +2555,64 @@ public:
     preamble += "template <class _T>\n";
     preamble += "using __resumable_local_type_t = typename __resumable_local_type<_T>::_Type;\n";
     preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "struct __resumable_spilled_box\n";
+    preamble += "{\n";
+    preamble += "  __resumable_spilled_box() {}\n";
+    preamble += "\n";
+    preamble += "  template <class... _Args>\n";
+    preamble += "  explicit __resumable_spilled_box(int, _Args&&... __args)\n";
+    preamble += "    : __value(static_cast<_Args&&>(__args)...) {}\n";
+    preamble += "\n";
+    preamble += "  _T __value;\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "class __resumable_spilled_local\n";
+    preamble += "{\n";
+    preamble += "  typedef __resumable_spilled_box<_T> _Box;\n";
+    preamble += "\n";
+    preamble += "  typedef typename ::std::conditional<::std::is_copy_constructible<_Box>::value,\n";
+    preamble += "      __resumable_spilled_local,\n";
+    preamble += "      __resumable_copy_disabled<__resumable_spilled_local>\n";
+    preamble += "    >::type _CopyArg;\n";
+    preamble += "\n";
+    preamble += "public:\n";
+    preamble += "  __resumable_spilled_local()\n";
+    preamble += "    : __box(new _Box) {}\n";
+    preamble += "\n";
+    preamble += "  template <class _Arg, class... _Args, class = typename ::std::enable_if<\n";
+    preamble += "    !::std::is_same<typename ::std::decay<_Arg>::type, __resumable_spilled_local>::value>::type>\n";
+    preamble += "  explicit __resumable_spilled_local(_Arg&& __arg, _Args&&... __args)\n";
+    preamble += "    : __box(new _Box(0, static_cast<_Arg&&>(__arg), static_cast<_Args&&>(__args)...)) {}\n";
+    preamble += "\n";
+    preamble += "  __resumable_spilled_local(const _CopyArg& __other)\n";
+    preamble += "    : __box(new _Box(*__other.__box)) {}\n";
+    preamble += "\n";
+    preamble += "  __resumable_spilled_local(__resumable_spilled_local&& __other) noexcept\n";
+    preamble += "    : __box(__other.__box)\n";
+    preamble += "  {\n";
+    preamble += "    __other.__box = nullptr;\n";
+    preamble += "  }\n";
+    preamble += "\n";
+    preamble += "  ~__resumable_spilled_local()\n";
+    preamble += "  {\n";
+    preamble += "    delete __box;\n";
+    preamble += "  }\n";
+    preamble += "\n";
+    preamble += "  __resumable_spilled_local& operator=(const __resumable_spilled_local&) = delete;\n";
+    preamble += "\n";
+    preamble += "  _T& operator*() const noexcept\n";
+    preamble += "  {\n";
+    preamble += "    return __box->__value;\n";
+    preamble += "  }\n";
+    preamble += "\n";
+    preamble += "private:\n";
+    preamble += "  _Box* __box;\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "#define resumable_spill\n";
+    preamble += "\n";
     preamble += "template <class _T, class... _Args>\n";
     preamble += "inline void __resumable_local_new(::std::true_type, _T* __p, _Args&&... __args)\n";
     preamble += "{\n";
@@ -1814,6 +2627,43 @@ public:
     preamble += "template <class>\n";
     preamble += "struct __resumable_check { typedef void _Type; };\n";
     preamble += "\n";
+    preamble += "typedef const void* __resumable_type_id;\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "struct __resumable_type_tag\n";
+    preamble += "{\n";
+    preamble += "  static const char __tag;\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "const char __resumable_type_tag<_T>::__tag = 0;\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "constexpr __resumable_type_id __resumable_type_id_of() noexcept\n";
+    preamble += "{\n";
+    preamble += "  return &__resumable_type_tag<_T>::__tag;\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "typedef __resumable_type_id resumable_type_id;\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "constexpr resumable_type_id resumable_type_id_of() noexcept\n";
+    preamble += "{\n";
+    preamble += "  return __resumable_type_id_of<_T>();\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _L>\n";
+    preamble += "struct __resumable_generic : _L\n";
+    preamble += "{\n";
+    preamble += "  using _L::_L;\n";
+    preamble += "\n";
+    preamble += "  template <class... _Args>\n";
+    preamble += "  decltype(auto) operator()(_Args&&... __args)\n";
+    preamble += "  {\n";
+    preamble += "    return this->__call_operator()(static_cast<_Args&&>(__args)...);\n";
+    preamble += "  }\n";
+    preamble += "};\n";
+    preamble += "\n";
     preamble += "template <class _T>\n";
     preamble += "struct __resumable_generator : _T {};\n";
     preamble += "\n";
@@ -1879,41 +2729,167 @@ public:
     preamble += "{\n";
     preamble += "}\n";
     preamble += "\n";
-    preamble += "template <class _T, class _Result>\n";
-    preamble += "struct __resumable_generator_invoke\n";
+    preamble += "struct __resumable_batch\n";
     preamble += "{\n";
-    preamble += "  _Result __result;\n";
-    preamble += "  explicit __resumable_generator_invoke(_T& __t) : __result(__t()) {}\n";
-    preamble += "  _Result __get() { return static_cast<_Result&&>(__result); }\n";
+    preamble += "  void* __out = nullptr;\n";
+    preamble += "  ::std::size_t __room = 0;\n";
     preamble += "};\n";
     preamble += "\n";
+    preamble += "template <class _T = void, class _U>\n";
+    preamble += "inline void __resumable_batch_put(__resumable_batch& __b, _U&& __u)\n";
+    preamble += "{\n";
+    preamble += "  typedef typename ::std::decay<typename ::std::conditional<\n";
+    preamble += "    ::std::is_void<_T>::value, _U, _T>::type>::type _Value;\n";
+    preamble += "  _Value* __p = static_cast<_Value*>(__b.__out);\n";
+    preamble += "  *__p = static_cast<_U&&>(__u);\n";
+    preamble += "  __b.__out = __p + 1;\n";
+    preamble += "  --__b.__room;\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _G, class _T>\n";
+    preamble += "inline ::std::size_t __resumable_resume_n(_G& __g, _T* __out, ::std::size_t __n, int,\n";
+    preamble += "    typename __resumable_check<decltype(__g.__batch)>::_Type* = 0)\n";
+    preamble += "{\n";
+    preamble += "  ::std::size_t __i = 0;\n";
+    preamble += "  while (__i < __n && !__g.is_terminal())\n";
+    preamble += "  {\n";
+    preamble += "    __g.__batch.__out = __out + __i;\n";
+    preamble += "    __g.__batch.__room = __n - __i - 1;\n";
+    preamble += "    _T __last = __g();\n";
+    preamble += "    __i = static_cast<_T*>(__g.__batch.__out) - __out;\n";
+    preamble += "    __g.__batch.__room = 0;\n";
+    preamble += "    __out[__i++] = static_cast<_T&&>(__last);\n";
+    preamble += "  }\n";
+    preamble += "  return __i;\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _G, class _T>\n";
+    preamble += "inline ::std::size_t __resumable_resume_n(_G& __g, _T* __out, ::std::size_t __n, long)\n";
+    preamble += "{\n";
+    preamble += "  ::std::size_t __i = 0;\n";
+    preamble += "  while (__i < __n && !__g.is_terminal())\n";
+    preamble += "    __out[__i++] = __g();\n";
+    preamble += "  return __i;\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _G, class _T>\n";
+    preamble += "inline ::std::size_t resume_n(_G& __g, _T* __out, ::std::size_t __n)\n";
+    preamble += "{\n";
+    preamble += "  static_assert(::std::is_same<_T, typename ::std::decay<decltype(__g())>::type>::value,\n";
+    preamble += "      \"resume_n output type must match the generator's result type\");\n";
+    preamble += "  return __resumable_resume_n(__g, __out, __n, 0);\n";
+    preamble += "}\n";
+    preamble += "\n";
     preamble += "template <class _T>\n";
-    preamble += "struct __resumable_generator_invoke<_T, void>\n";
+    preamble += "constexpr int resumable_state(const _T& __t,\n";
+    preamble += "    typename __resumable_check<decltype(__t.state())>::_Type* = 0) noexcept\n";
     preamble += "{\n";
-    preamble += "  explicit __resumable_generator_invoke(_T& __t) { __t(); }\n";
-    preamble += "  void __get() {}\n";
-    preamble += "};\n";
+    preamble += "  return __t.state();\n";
+    preamble += "}\n";
     preamble += "\n";
     preamble += "template <class _T>\n";
-    preamble += "inline bool is_initial(const _T& __t,\n";
+    preamble += "constexpr bool is_initial(const _T& __t,\n";
     preamble += "    typename __resumable_check<decltype(__t.is_initial())>::_Type* = 0) noexcept\n";
     preamble += "{\n";
     preamble += "  return __t.is_initial();\n";
     preamble += "}\n";
     preamble += "\n";
     preamble += "template <class _T>\n";
-    preamble += "inline bool is_terminal(const _T& __t,\n";
-    preamble += "    typename __resumable_check<decltype(__t.is_terminal())>::_Type* = 0) noexcept\n";
+    preamble += "constexpr bool is_terminal(const _T& __t,\n";
+    preamble += "    typename __resumable_check<decltype(__t.is_terminal())>::_Type* = 0)\n";
+    preamble += "  noexcept(noexcept(__t.is_terminal()))\n";
     preamble += "{\n";
     preamble += "  return __t.is_terminal();\n";
     preamble += "}\n";
     preamble += "\n";
     preamble += "template <class _T>\n";
+    preamble += "inline void reset(_T& __t,\n";
+    preamble += "    typename __resumable_check<decltype(__t.reset())>::_Type* = 0) noexcept\n";
+    preamble += "{\n";
+    preamble += "  __t.reset();\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T, class... _Args>\n";
+    preamble += "inline auto rebind(_T& __t, _Args&&... __args)\n";
+    preamble += "  -> decltype(__t.rebind(static_cast<_Args&&>(__args)...))\n";
+    preamble += "{\n";
+    preamble += "  static_assert(_T::__is_nothrow_rebindable_v,\n";
+    preamble += "      \"rebind() needs captures that can be moved without throwing\");\n";
+    preamble += "  return __t.rebind(static_cast<_Args&&>(__args)...);\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "class resumable_ref\n";
+    preamble += "{\n";
+    preamble += "public:\n";
+    preamble += "  typedef _T type;\n";
+    preamble += "\n";
+    preamble += "  explicit resumable_ref(_T* __p) noexcept : __p_(__p) {}\n";
+    preamble += "\n";
+    preamble += "  _T& get() const noexcept { return *__p_; }\n";
+    preamble += "  bool is_initial() const noexcept { return __p_->is_initial(); }\n";
+    preamble += "  bool is_terminal() const noexcept { return __p_->is_terminal(); }\n";
+    preamble += "  int state() const noexcept { return __p_->state(); }\n";
+    preamble += "\n";
+    preamble += "  template <class... _Args>\n";
+    preamble += "  auto operator()(_Args&&... __args) const\n";
+    preamble += "    -> decltype(::std::declval<_T&>()(static_cast<_Args&&>(__args)...))\n";
+    preamble += "  {\n";
+    preamble += "    return (*__p_)(static_cast<_Args&&>(__args)...);\n";
+    preamble += "  }\n";
+    preamble += "\n";
+    preamble += "private:\n";
+    preamble += "  _T* __p_;\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline resumable_ref<_T> lambda_ref(_T* __p) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return resumable_ref<_T>(__p);\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline bool is_preempted(const _T& __t,\n";
+    preamble += "    typename __resumable_check<decltype(__t.is_preempted())>::_Type* = 0) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return __t.is_preempted();\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "struct __resumable_preemption_budget\n";
+    preamble += "{\n";
+    preamble += "  unsigned __limit;\n";
+    preamble += "  unsigned __left;\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "inline __resumable_preemption_budget& __resumable_preemption() noexcept\n";
+    preamble += "{\n";
+    preamble += "  static thread_local __resumable_preemption_budget __budget = { 0, 0 };\n";
+    preamble += "  return __budget;\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "inline bool __resumable_preempt() noexcept\n";
+    preamble += "{\n";
+    preamble += "  __resumable_preemption_budget& __budget = __resumable_preemption();\n";
+    preamble += "  if (__budget.__limit == 0 || --__budget.__left != 0)\n";
+    preamble += "    return false;\n";
+    preamble += "  __budget.__left = __budget.__limit;\n";
+    preamble += "  return true;\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "inline void set_preemption_budget(unsigned __n) noexcept\n";
+    preamble += "{\n";
+    preamble += "  __resumable_preemption_budget& __budget = __resumable_preemption();\n";
+    preamble += "  __budget.__limit = __budget.__left = __n;\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "#if __RESUMABLE_RTTI\n";
+    preamble += "template <class _T>\n";
     preamble += "inline const ::std::type_info& wanted_type(const _T& __t,\n";
     preamble += "    typename __resumable_check<decltype(__t.wanted_type())>::_Type* = 0) noexcept\n";
     preamble += "{\n";
     preamble += "  return __t.wanted_type();\n";
     preamble += "}\n";
+    preamble += "#endif // __RESUMABLE_RTTI\n";
     preamble += "\n";
     preamble += "template <class _T>\n";
     preamble += "inline void* wanted(_T& __t,\n";
@@ -1930,6 +2906,70 @@ public:
     preamble += "}\n";
     preamble += "\n";
     preamble += "template <class _T>\n";
+    preamble += "inline void* __resumable_wanted_member(_T& __t, __resumable_type_id __id, int,\n";
+    preamble += "    typename __resumable_check<decltype(__t.wanted(__id))>::_Type* = 0) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return __t.wanted(__id);\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline void* __resumable_wanted_member(_T& __t, __resumable_type_id __id, long) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return __id == __resumable_type_id_of<_T>() ? __t.wanted() : nullptr;\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline void* __resumable_wanted(_T& __t, __resumable_type_id __id) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return __resumable_wanted_member(__t, __id, 0);\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline void* __resumable_wanted(__resumable_generator<_T>& __t, __resumable_type_id __id) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return __resumable_wanted(static_cast<_T&>(__t), __id);\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline void* wanted(_T& __t, resumable_type_id __id) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return __resumable_wanted(__t, __id);\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _W, class _T>\n";
+    preamble += "inline _W* wanted_as(_T& __t) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return static_cast<_W*>(__resumable_wanted(__t, resumable_type_id_of<_W>()));\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline void* __resumable_delegate_member(_T& __t, __resumable_type_id __id, int,\n";
+    preamble += "    typename __resumable_check<decltype(__t.delegate(__id))>::_Type* = 0) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return __t.delegate(__id);\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline void* __resumable_delegate_member(_T&, __resumable_type_id, long) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return nullptr;\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline void* __resumable_delegate(_T& __t, __resumable_type_id __id) noexcept\n";
+    preamble += "{\n";
+    preamble += "  if (__id == __resumable_type_id_of<_T>())\n";
+    preamble += "    return &__t;\n";
+    preamble += "  return __resumable_delegate_member(__t, __id, 0);\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _G, class _T>\n";
+    preamble += "inline _G* delegate(_T& __t) noexcept\n";
+    preamble += "{\n";
+    preamble += "  return static_cast<_G*>(__resumable_delegate_member(__t, __resumable_type_id_of<_G>(), 0));\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
     preamble += "inline auto initializer(_T&& __t,\n";
     preamble += "    typename __resumable_check<typename decltype(*::std::declval<_T>())::generator_type>::_Type* = 0)\n";
     preamble += "{\n";
@@ -1951,6 +2991,47 @@ public:
     preamble += "\n";
     preamble += "template <class _T> using lambda_t = typename lambda<_T>::type;\n";
     preamble += "\n";
+    preamble += "template <class _T, class = void>\n";
+    preamble += "struct __resumable_trivially_relocatable :\n";
+    preamble += "  ::std::is_trivially_copyable<_T> {};\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "struct __resumable_trivially_relocatable<_T,\n";
+    preamble += "  typename __resumable_check<decltype(_T::__is_trivially_relocatable_v)>::_Type> :\n";
+    preamble += "    ::std::integral_constant<bool, _T::__is_trivially_relocatable_v> {};\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "struct resumable_frame_traits\n";
+    preamble += "{\n";
+    preamble += "  typedef lambda_t<_T> frame_type;\n";
+    preamble += "  static constexpr ::std::size_t size = sizeof(frame_type);\n";
+    preamble += "  static constexpr ::std::size_t alignment = alignof(frame_type);\n";
+    preamble += "  static constexpr bool is_trivially_relocatable =\n";
+    preamble += "    __resumable_trivially_relocatable<frame_type>::value;\n";
+    preamble += "};\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "constexpr ::std::size_t resumable_frame_traits<_T>::size;\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "constexpr ::std::size_t resumable_frame_traits<_T>::alignment;\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "constexpr bool resumable_frame_traits<_T>::is_trivially_relocatable;\n";
+    preamble += "\n";
+    preamble += "template <class _T>\n";
+    preamble += "inline lambda_t<typename ::std::decay<_T>::type>* emplace_into(void* __p, _T&& __t)\n";
+    preamble += "{\n";
+    preamble += "  typedef lambda_t<typename ::std::decay<_T>::type> _Frame;\n";
+    preamble += "  return new (__p) _Frame(static_cast<_T&&>(__t));\n";
+    preamble += "}\n";
+    preamble += "\n";
+    preamble += "template <class _F>\n";
+    preamble += "inline void destroy_frame(_F* __f) noexcept\n";
+    preamble += "{\n";
+    preamble += "  __f->~_F();\n";
+    preamble += "}\n";
+    preamble += "\n";
     preamble += "#endif // __RESUMABLE_PREAMBLE\n";
     preamble += "\n";
     if (line_numbers)
@@ -1969,21 +3050,35 @@ int main(int argc, const char* argv[])
 {
   if (argc < 2)
   {
-    std::cerr << "Usage: resumable-pp [-l] [-p <allowed_path> ] [-v] <source> [clang args]\n";
+    std::cerr << "Usage: resumable-pp [-b] [-c] [-i] [-l] [-n] [-p <allowed_path> ] [-s <bytes>] [-v] <source> [clang args]\n";
     return 1;
   }
 
   int arg = 1;
   while (arg < argc && argv[arg][0] == '-')
   {
-    if (argv[arg] == std::string("-l"))
+    if (argv[arg] == std::string("-b"))
+      preemption_points = true;
+    else if (argv[arg] == std::string("-c"))
+      constexpr_lambdas = true;
+    else if (argv[arg] == std::string("-i"))
+      inline_generators = true;
+    else if (argv[arg] == std::string("-l"))
       line_numbers = true;
+    else if (argv[arg] == std::string("-n"))
+      batch_yields = true;
     else if (argv[arg] == std::string("-p"))
     {
       ++arg;
       if (arg < argc)
         allowed_path = argv[arg];
     }
+    else if (argv[arg] == std::string("-s"))
+    {
+      ++arg;
+      if (arg < argc)
+        spill_threshold = std::strtoul(argv[arg], nullptr, 10);
+    }
     else if (argv[arg] == std::string("-v"))
       verbose = true;
     ++arg;
@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include <resumable/arena.hpp>
+
+int main()
+{
+  resumable_arena arena(256);
+
+  char* a = static_cast<char*>(arena.allocate(16));
+  char* b = static_cast<char*>(arena.allocate(16));
+  char* c = static_cast<char*>(arena.allocate(16));
+  printf("%d\n", a < b && b < c);
+
+  // Freed out of order, b is only reclaimed once c has gone too.
+  arena.deallocate(b);
+  char* d = static_cast<char*>(arena.allocate(16));
+  printf("%d\n", d > c);
+  arena.deallocate(d);
+  arena.deallocate(c);
+  char* e = static_cast<char*>(arena.allocate(16));
+  printf("%d\n", e == b);
+
+  // Blocks larger than a segment get a segment of their own.
+  char* big = static_cast<char*>(arena.allocate(1024));
+  big[1023] = 0;
+  arena.deallocate(big);
+  arena.deallocate(e);
+  arena.deallocate(a);
+
+  // Once everything has been freed, the arena starts again from the bottom.
+  printf("%d\n", arena.allocate(16) == a);
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <resumable/array.hpp>
+
+auto agent(int id)
+{
+  return [id]() resumable
+  {
+    yield id;
+    if (id % 2)
+      yield id * 10;
+    yield id * 100;
+    return -id;
+  };
+}
+
+auto countdown(int n)
+{
+  return [n]() resumable
+  {
+    while (n > 1)
+      yield n--;
+    return n;
+  };
+}
+
+auto relay(int id)
+{
+  return [id]() resumable
+  {
+    yield id;
+    return from countdown(id);
+  };
+}
+
+int main()
+{
+  resumable_array<decltype(agent(0))> agents(3);
+  agents.emplace(agent(1));
+  agents.emplace(agent(2));
+  agents.emplace(agent(3));
+
+  while (agents.resume_all([](std::size_t i, int v) { printf("[%d] %d\n", static_cast<int>(i), v); }) > 0)
+    printf("--\n");
+
+  // An instance that ends with "return from" is not resumed again once its
+  // sub-generator has finished.
+  resumable_array<decltype(relay(0))> relays(2);
+  relays.emplace(relay(2));
+  relays.emplace(relay(3));
+
+  while (relays.resume_all([](std::size_t i, int v) { printf("[%d] %d\n", static_cast<int>(i), v); }) > 0)
+    printf("--\n");
+}
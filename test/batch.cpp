@@ -0,0 +1,21 @@
+#include <stdio.h>
+
+int main()
+{
+  auto f = [n = int(10)]() resumable
+  {
+    while (--n > 0)
+      if (n == 1) return n;
+      else yield n;
+  };
+
+  int values[4];
+  while (!is_terminal(f))
+  {
+    std::size_t count = resume_n(f, values, 4);
+    printf("%d:", static_cast<int>(count));
+    for (std::size_t i = 0; i < count; ++i)
+      printf(" %d", values[i]);
+    printf("\n");
+  }
+}
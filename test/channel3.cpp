@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <vector>
+#include <resumable/channel.hpp>
+
+int main()
+{
+  {
+    resumable_channel<int, 4> c;
+
+    auto&& pusher = [&]() resumable
+    {
+      int i;
+      for (i = 0; i < 10; ++i)
+        yield from c.push(&i);
+      i = -1;
+      yield from c.push(&i);
+    };
+
+    auto&& puller = [&]() resumable
+    {
+      int i;
+      do
+      {
+        yield from c.pull(&i);
+        printf("%d\n", i);
+      } while (i != -1);
+    };
+
+    while (!is_terminal(puller))
+    {
+      if (!is_terminal(pusher))
+        pusher();
+      puller();
+    }
+  }
+
+  {
+    // Two pullers waiting on an empty channel are served in turn.
+    resumable_channel<int, 4> c;
+
+    auto&& pusher = [&]() resumable
+    {
+      int i;
+      for (i = 0; i < 10; ++i)
+        yield from c.push(&i);
+      i = -1;
+      yield from c.push(&i);
+      yield from c.push(&i);
+    };
+
+    auto&& first = [&]() resumable
+    {
+      int i;
+      do
+      {
+        yield from c.pull(&i);
+        printf("first %d\n", i);
+      } while (i != -1);
+    };
+
+    auto&& second = [&]() resumable
+    {
+      int i;
+      do
+      {
+        yield from c.pull(&i);
+        printf("second %d\n", i);
+      } while (i != -1);
+    };
+
+    while (!is_terminal(first) || !is_terminal(second))
+    {
+      if (!is_terminal(first))
+        first();
+      if (!is_terminal(second))
+        second();
+      if (!is_terminal(pusher))
+        pusher();
+    }
+  }
+
+  {
+    // 100000 values in batches of 3000, through a buffer of 1024.
+    resumable_channel<int, 1024> c;
+    int pushes = 0, pulls = 0;
+
+    auto&& producer = [&, batch = std::vector<int>(3000), k = std::size_t(0),
+         next = int(0)]() resumable
+    {
+      while (next < 100000)
+      {
+        for (k = 0; k < batch.size() && next < 100000; ++k)
+          batch[k] = next++;
+        yield from c.push_n(batch.data(), k);
+      }
+    };
+
+    auto&& consumer = [&, batch = std::vector<int>(4096), n = std::size_t(0),
+         expected = int(0), in_order = true]() resumable
+    {
+      while (expected < 100000)
+      {
+        yield from c.pull_n(batch.data(), batch.size(), &n);
+        for (std::size_t i = 0; i < n; ++i)
+          if (batch[i] != expected++)
+            in_order = false;
+      }
+      printf("%d %d\n", expected, in_order);
+    };
+
+    while (!is_terminal(consumer))
+    {
+      if (!is_terminal(producer))
+      {
+        producer();
+        ++pushes;
+      }
+      consumer();
+      ++pulls;
+    }
+    printf("%d %d %d\n", pushes, pulls, static_cast<int>(c.size()));
+  }
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+
+#if defined(__RESUMABLE_PREAMBLE)
+# define CONSTEXPR_GENERATOR constexpr
+#else
+# define CONSTEXPR_GENERATOR
+#endif
+
+template <class G>
+constexpr int sum_of(G g, int n)
+{
+  int sum = 0;
+  for (int i = 0; i < n; ++i)
+    sum += g();
+  return sum;
+}
+
+// A lambda that delegates with yield from and return from can be run to the
+// end during constant evaluation, and is then in its terminal state.
+CONSTEXPR_GENERATOR int delegated()
+{
+  auto f1 = [n = int(4)]() resumable -> int
+  {
+    while (--n > 0)
+      if (n == 1) return n;
+      else yield n;
+  };
+
+  auto f2 = [n = int(3)]() resumable -> int
+  {
+    while (--n > 0)
+      if (n == 1) return n;
+      else yield n;
+  };
+
+  auto f3 = [&]() resumable -> int
+  {
+    yield from f1;
+    return from f2;
+  };
+
+  int sum = 0;
+  while (!is_terminal(f3))
+    sum += f3();
+  return resumable_state(f3) == -1 ? sum : -1;
+}
+
+int main()
+{
+  CONSTEXPR_GENERATOR auto squares = [i = 0]() resumable -> int
+  {
+    for (;;)
+    {
+      yield i * i;
+      ++i;
+    }
+  };
+
+#if defined(__RESUMABLE_PREAMBLE)
+  static_assert(sum_of(squares, 5) == 30, "sum of squares");
+  static_assert(delegated() == 9, "delegating lambda");
+#endif
+
+  printf("%d\n", sum_of(squares, 5));
+
+  // Delegating to another generator creates no locals either.
+  auto f1 = [n = int(4)]() resumable -> int
+  {
+    while (--n > 0)
+      if (n == 1) return n;
+      else yield n;
+  };
+
+  auto f2 = [n = int(3)]() resumable -> int
+  {
+    while (--n > 0)
+      if (n == 1) return n;
+      else yield n;
+  };
+
+  auto f3 = [&]() resumable -> int
+  {
+    yield from f1;
+    return from f2;
+  };
+
+  while (!is_terminal(f3))
+    printf("%d\n", f3());
+}
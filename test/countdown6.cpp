@@ -0,0 +1,26 @@
+#include <stdio.h>
+
+template <class T>
+auto countdown(T n)
+{
+  return [n]() resumable
+  {
+    while (--n > 0)
+      if (n == 1) return n;
+      else yield n;
+  };
+}
+
+// countdown5 with -i, which only adds an inlining hint, so the results must
+// be the same.
+int main()
+{
+  auto f = [&]() resumable
+  {
+    yield from countdown(10);
+    return from countdown(5);
+  };
+
+  while (!is_terminal(f))
+    printf("%d\n", f());
+}
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <string>
+
+auto countdown(int n)
+{
+  return [n]() resumable
+  {
+    while (--n > 0)
+      if (n == 1) return n;
+      else yield n;
+  };
+}
+
+int main()
+{
+  typedef decltype(initializer(countdown(0))) init_type;
+  typedef resumable_frame_traits<init_type> traits;
+
+  alignas(traits::alignment) unsigned char storage[traits::size];
+  auto* f = emplace_into(storage, initializer(countdown(4)));
+  while (!is_terminal(*f))
+    printf("%d\n", (*f)());
+  destroy_frame(f);
+
+  printf("%d\n", traits::is_trivially_relocatable ? 1 : 0);
+
+  auto g = [s = std::string("hello")]() resumable
+  {
+    yield s.size();
+  };
+
+  printf("%d\n", resumable_frame_traits<decltype(g)>::is_trivially_relocatable ? 1 : 0);
+}
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <utility>
+#include <resumable/generator.hpp>
+
+resumable_generator<int> counter(int n)
+{
+  return [n, i = int(0)]() resumable -> int
+  {
+    while (i < n - 1)
+      yield i++;
+    return i;
+  };
+}
+
+resumable_generator<int> twice(int n)
+{
+  return [n]() resumable -> int
+  {
+    yield from counter(n);
+    return from counter(n);
+  };
+}
+
+int main()
+{
+  resumable_generator<int> g = counter(4);
+  printf("%d\n", g());
+
+  resumable_generator<int> c = g.clone();
+  printf("%d %d\n", g(), c());
+
+  resumable_generator<int> m(std::move(g));
+  printf("%d %d\n", is_terminal(g), is_terminal(m));
+  while (!is_terminal(m))
+    printf("%d\n", m());
+
+  resumable_generator<int> t = twice(2);
+  while (!is_terminal(t))
+    printf("%d\n", t());
+}
@@ -0,0 +1,18 @@
+#include <stdio.h>
+#include <string>
+
+int main()
+{
+  auto twice = [](const auto& value) resumable
+  {
+    yield value;
+    return value;
+  };
+
+  printf("%d\n", twice(1));
+  printf("%d\n", twice(2));
+
+  reset(twice);
+  printf("%s\n", twice(std::string("three")).c_str());
+  printf("%s\n", twice(std::string("four")).c_str());
+}
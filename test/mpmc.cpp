@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <atomic>
+#include <deque>
+#include <resumable/mpmc_channel.hpp>
+#include <resumable/work_stealing.hpp>
+
+typedef resumable_mpmc_channel<int, 16> channel;
+
+// Pushes n, n - 1, ..., 1 and then 0 to mark the end.
+auto producer(resumable_stealing_scheduler& sched, channel& c, int n)
+{
+  return [&sched, &c, n, i = int(0)]() resumable
+  {
+    for (i = n; i >= 0; --i)
+      yield from c.push(&i, resumable_waker(sched, lambda_ref(lambda_this)));
+  };
+}
+
+// Pulls until it sees an end marker.
+auto consumer(resumable_stealing_scheduler& sched, channel& c, std::atomic<long>& sum)
+{
+  return [&sched, &c, &sum, v = int(0)]() resumable
+  {
+    do
+    {
+      yield from c.pull(&v, resumable_waker(sched, lambda_ref(lambda_this)));
+      sum.fetch_add(v, std::memory_order_relaxed);
+    } while (v != 0);
+  };
+}
+
+typedef decltype(producer(std::declval<resumable_stealing_scheduler&>(),
+  std::declval<channel&>(), 0)) producer_type;
+typedef decltype(consumer(std::declval<resumable_stealing_scheduler&>(),
+  std::declval<channel&>(), std::declval<std::atomic<long>&>())) consumer_type;
+
+int main()
+{
+  channel c;
+  std::atomic<long> sum(0);
+  std::deque<resumable_task<producer_type>> producers;
+  std::deque<resumable_task<consumer_type>> consumers;
+
+  resumable_stealing_scheduler sched(4);
+
+  // Every value is pushed before its producer's end marker, and values are
+  // pulled in the order they were pushed, so the last end marker comes after
+  // every value and each consumer stops at one of the markers.
+  for (int i = 0; i < 4; ++i)
+  {
+    producers.emplace_back(producer(sched, c, 20000));
+    consumers.emplace_back(consumer(sched, c, sum));
+  }
+  for (auto& t : consumers)
+    sched.post(t);
+  for (auto& t : producers)
+    sched.post(t);
+  sched.wait();
+
+  int terminal = 0;
+  for (auto& t : producers)
+    terminal += is_terminal(t);
+  for (auto& t : consumers)
+    terminal += is_terminal(t);
+  printf("%ld %d\n", sum.load(), terminal);
+}
@@ -0,0 +1,28 @@
+#include <stdio.h>
+
+struct tracer
+{
+  explicit tracer(int i) : id(i) { printf("make %d\n", id); }
+  ~tracer() { printf("drop %d\n", id); }
+  int id;
+};
+
+int main()
+{
+  // Built with -fno-exceptions. The plain return leaves both locals live,
+  // so they are only destroyed if the unwinder stays armed for returns.
+  auto f = [n = int(0)]() resumable
+  {
+    tracer outer(1);
+    for (;;)
+    {
+      tracer inner(2);
+      if (++n == 3)
+        return n;
+      yield n;
+    }
+  };
+
+  while (!is_terminal(f))
+    printf("%d\n", f());
+}
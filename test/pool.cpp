@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <resumable/pool.hpp>
+
+auto countdown(int n)
+{
+  return [n]() resumable
+  {
+    while (--n > 0)
+      if (n == 1) return n;
+      else yield n;
+  };
+}
+
+// Returns a reference to a value in its own frame.
+auto tens(int n)
+{
+  return [n, v = int(0)]() resumable -> const int&
+  {
+    for (;;)
+    {
+      v = n * 10;
+      if (--n == 0)
+        return v;
+      yield v;
+    }
+  };
+}
+
+typedef resumable_pool<decltype(initializer(countdown(0)))> pool;
+typedef resumable_pool<decltype(initializer(tens(0)))> ref_pool;
+
+int main()
+{
+  auto f = pool::make(initializer(countdown(4)));
+  while (!is_terminal(f))
+    printf("%d\n", f());
+  printf("%d\n", f.get() == nullptr);
+
+  // The last reference stays valid, because the frame is only recycled when
+  // the handle is destroyed.
+  auto r = ref_pool::make(initializer(tens(3)));
+  while (!is_terminal(r))
+  {
+    const int& v = r();
+    printf("%d\n", v);
+  }
+  printf("%d\n", r.get() == nullptr);
+
+  // Every frame returns its slot when it terminates, so the first block of
+  // slots is never exhausted.
+  int total = 0;
+  for (int i = 0; i < 100000; ++i)
+  {
+    auto g = pool::make(initializer(countdown(3)));
+    while (!is_terminal(g))
+      total += g();
+  }
+  printf("%d\n", total);
+  printf("%d\n", static_cast<int>(pool::capacity()));
+}
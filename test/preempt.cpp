@@ -0,0 +1,53 @@
+#include <stdio.h>
+
+int main()
+{
+  set_preemption_budget(4);
+
+  auto g = []() resumable -> long
+  {
+    long sum = 0;
+    for (int i = 1; i <= 10; ++i)
+    {
+      sum += i;
+    }
+    return sum;
+  };
+
+  int slices = 0;
+  long result = 0;
+  while (!is_terminal(g))
+  {
+    result = g();
+    if (is_preempted(g))
+      ++slices;
+  }
+
+  printf("%d slices, sum %ld\n", slices, result);
+
+  // Every iteration starts with the check, so one that ends in a continue is
+  // counted as well.
+  set_preemption_budget(4);
+
+  auto h = []() resumable -> long
+  {
+    long sum = 0;
+    for (int i = 1; i <= 10; ++i)
+    {
+      if (i % 2 == 0)
+        continue;
+      sum += i;
+    }
+    return sum;
+  };
+
+  slices = 0;
+  while (!is_terminal(h))
+  {
+    result = h();
+    if (is_preempted(h))
+      ++slices;
+  }
+
+  printf("%d slices, sum %ld\n", slices, result);
+}
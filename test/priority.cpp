@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <resumable/priority.hpp>
+
+typedef resumable_priority_scheduler<2> scheduler;
+
+auto once(const char* name)
+{
+  return [name]() resumable
+  {
+    printf("%s\n", name);
+  };
+}
+
+int main()
+{
+  scheduler sched;
+  sched.set_budget(1, 2);
+
+  auto x = make_task(once("x"));
+  auto y = make_task(once("y"));
+  auto z = make_task(once("z"));
+  auto u = make_task(once("u"));
+
+  // A batch task that hands an urgent task to the scheduler half way
+  // through. The urgent task runs as soon as the batch task yields.
+  auto b = make_task([&sched, &u, i = int(0)]() resumable
+  {
+    for (i = 0; i < 5; ++i)
+    {
+      printf("b: %d\n", i);
+      if (i == 2)
+        sched.post(u, 0, 5);
+      yield sched.post(lambda_ref(lambda_this), 1);
+    }
+  });
+
+  sched.post(b, 1);
+  sched.post(x, 0, 30);
+  sched.post(y, 0, 10);
+  sched.post(z, 0, 20);
+
+  // The batch class gets two resumes per tick.
+  while (!sched.empty())
+    printf("tick: %d\n", static_cast<int>(sched.tick()));
+
+  printf("%d %d %d %d %d\n", is_terminal(x), is_terminal(y),
+      is_terminal(z), is_terminal(u), is_terminal(b));
+
+  // Tasks without a deadline run after every task with one, even one that
+  // is posted after they have started to run, and the deadlines start
+  // afresh once the class has run dry. One resume per tick.
+  resumable_priority_scheduler<1> later(1);
+
+  auto p = make_task(once("p"));
+  auto q = make_task(once("q"));
+  auto d20 = make_task(once("d20"));
+  auto d5 = make_task(once("d5"));
+  auto d10 = make_task(once("d10"));
+  auto d3 = make_task(once("d3"));
+
+  later.post(p);
+  later.post(q);
+  later.post(d20, 0, 20);
+  later.tick();
+  later.tick();
+  later.post(d5, 0, 5);
+  later.run();
+  later.post(d10, 0, 10);
+  later.post(d3, 0, 3);
+  later.run();
+}
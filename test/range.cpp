@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <numeric>
+#include <string>
+#include <resumable/range.hpp>
+
+int main()
+{
+  auto numbers = [i = int(0)]() resumable -> int
+  {
+    for (;;)
+      yield i++;
+  };
+
+  auto odd = [](int i) { return i % 2 != 0; };
+  auto square = [](int i) { return i * i; };
+
+  for (int i : numbers | resumable_filter(odd) | resumable_map(square) | resumable_take(4))
+    printf("%d\n", i);
+
+  // The pipeline above held numbers by reference, so it carries on from 8.
+  printf("%d\n", numbers());
+
+  auto letters = [c = char('a')]() resumable -> char
+  {
+    while (c < 'g')
+      yield c++;
+    return c;
+  };
+
+  for (auto& v : letters | resumable_chunk(3))
+    printf("%s\n", std::string(v.begin(), v.end()).c_str());
+
+  auto countdown = [n = int(5)]() resumable -> int
+  {
+    while (n > 1)
+      yield n--;
+    return n;
+  };
+
+  auto r = as_range(countdown);
+  printf("%d\n", std::accumulate(r.begin(), r.end(), 0));
+}
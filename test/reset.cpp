@@ -0,0 +1,22 @@
+#include <stdio.h>
+#include <string>
+
+int main()
+{
+  auto g = [name = std::string("first"), limit = 3]() resumable
+  {
+    for (int i = 1; i < limit; ++i)
+      yield name + " " + std::to_string(i);
+    return name + " done";
+  };
+
+  while (!is_terminal(g))
+    printf("%s\n", g().c_str());
+
+  reset(g);
+  printf("%s\n", g().c_str());
+
+  rebind(g, std::string("second"), 2);
+  while (!is_terminal(g))
+    printf("%s\n", g().c_str());
+}
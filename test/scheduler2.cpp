@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <deque>
+
+class scheduler
+{
+public:
+  template <class F>
+  int post(resumable_ref<F> f)
+  {
+    tasks_.push_back(task{&f.get(), &invoke<F>});
+    return 0;
+  }
+
+  void run()
+  {
+    while (!tasks_.empty())
+    {
+      task t = tasks_.front();
+      tasks_.pop_front();
+      t.invoke(t.frame);
+    }
+  }
+
+private:
+  struct task
+  {
+    void* frame;
+    void (*invoke)(void*);
+  };
+
+  template <class F>
+  static void invoke(void* frame)
+  {
+    (*static_cast<F*>(frame))();
+  }
+
+  std::deque<task> tasks_;
+};
+
+int main()
+{
+  scheduler sched;
+
+  auto f = [&sched, i = int(0)]() resumable
+  {
+    for (i = 0; i < 10; ++i)
+    {
+      printf("f: %d\n", i);
+      yield sched.post(lambda_ref(lambda_this));
+    }
+  };
+
+  auto g = [&sched, i = int(0)]() resumable
+  {
+    for (i = 0; i < 5; ++i)
+    {
+      printf("g: %d\n", i);
+      yield sched.post(lambda_ref(lambda_this));
+    }
+  };
+
+  sched.post(lambda_ref(&f));
+  sched.post(lambda_ref(&g));
+  sched.run();
+
+  printf("%d %d\n", is_terminal(f), is_terminal(g));
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <resumable/scheduler.hpp>
+
+static int allocations = 0;
+
+void* operator new(std::size_t n)
+{
+  ++allocations;
+  if (void* p = malloc(n))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+int main()
+{
+  resumable_scheduler sched;
+
+  auto f = make_task([&sched, i = int(0)]() resumable
+  {
+    for (i = 0; i < 10; ++i)
+    {
+      printf("f: %d\n", i);
+      yield sched.post(lambda_ref(lambda_this));
+    }
+  });
+
+  auto g = make_task([&sched, i = int(0)]() resumable
+  {
+    for (i = 0; i < 5; ++i)
+    {
+      printf("g: %d\n", i);
+      yield sched.post(lambda_ref(lambda_this));
+    }
+  });
+
+  sched.post(f);
+  sched.post(g);
+  int before = allocations;
+  int resumes = static_cast<int>(sched.run());
+
+  printf("%d %d %d\n", resumes, is_terminal(f), is_terminal(g));
+  printf("%d\n", allocations - before);
+}
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <resumable/sharded.hpp>
+
+struct relay_state
+{
+  explicit relay_state(resumable_sharded_scheduler& s)
+    : sched(s), hops(0), misplaced(0)
+  {
+  }
+
+  resumable_sharded_scheduler& sched;
+  std::vector<resumable_hook*> ring;
+  std::atomic<long> hops;
+  std::atomic<int> misplaced;
+};
+
+// Two neighbours in a ring share a shard, so the token passes both within a
+// shard and from one shard to the next.
+unsigned shard_of(const relay_state& r, std::size_t index)
+{
+  return (index / 2) % r.sched.size();
+}
+
+auto member(relay_state& r, std::size_t index, int rounds)
+{
+  return [&r, index, rounds, i = int(0)]() resumable
+  {
+    for (i = 0; i < rounds; ++i)
+    {
+      if (r.sched.current_shard() != shard_of(r, index))
+        r.misplaced.fetch_add(1, std::memory_order_relaxed);
+      r.hops.fetch_add(1, std::memory_order_relaxed);
+
+      std::size_t next = (index + 1) % r.ring.size();
+      if (next != 0 || i + 1 < rounds)
+        r.sched.post(shard_of(r, next), *r.ring[next]);
+      yield 0;
+    }
+  };
+}
+
+typedef decltype(member(std::declval<relay_state&>(), 0, 0)) member_type;
+
+int main()
+{
+  resumable_sharded_scheduler sched(4, false);
+
+  // Eight rings of twelve tasks, each with one token going round it ten
+  // times.
+  std::deque<relay_state> relays;
+  std::deque<resumable_task<member_type>> tasks;
+  for (int k = 0; k < 8; ++k)
+  {
+    relays.emplace_back(sched);
+    relay_state& r = relays.back();
+    for (std::size_t i = 0; i < 12; ++i)
+    {
+      tasks.emplace_back(member(r, i, 10));
+      r.ring.push_back(&tasks.back());
+    }
+  }
+
+  for (auto& r : relays)
+    sched.post(shard_of(r, 0), *r.ring[0]);
+  sched.wait();
+
+  long hops = 0;
+  int misplaced = 0;
+  for (auto& r : relays)
+  {
+    hops += r.hops.load();
+    misplaced += r.misplaced.load();
+  }
+  printf("%ld %d\n", hops, misplaced);
+
+  // Each task is left suspended after its last yield, and one more resume on
+  // its own shard finishes it.
+  for (auto& r : relays)
+    for (std::size_t i = 0; i < r.ring.size(); ++i)
+      sched.post(shard_of(r, i), *r.ring[i]);
+  sched.wait();
+
+  int terminal = 0;
+  for (auto& t : tasks)
+    terminal += is_terminal(t);
+  printf("%d\n", terminal);
+}
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <string>
+#include <utility>
+
+int main()
+{
+  auto g1 = []() resumable -> std::string
+  {
+    char buf[64 * 1024];
+    for (int i = 1; i <= 3; ++i)
+    {
+      snprintf(buf, sizeof(buf), "chunk %d of %d", i, static_cast<int>(sizeof(buf)));
+      yield std::string(buf);
+    }
+  };
+
+  printf("%s\n", g1().c_str());
+  auto g2(std::move(g1));
+  printf("%s\n", g2().c_str());
+  printf("%s\n", g2().c_str());
+  printf("%d\n", sizeof(g2) < 1024 ? 1 : 0);
+
+  auto g3 = []() resumable -> int
+  {
+    int n resumable_spill = 0;
+    for (;;)
+      yield ++n;
+  };
+
+  printf("%d\n", g3());
+  printf("%d\n", g3());
+  printf("%d\n", resumable_frame_traits<decltype(g3)>::is_trivially_relocatable ? 1 : 0);
+}
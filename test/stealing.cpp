@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <atomic>
+#include <deque>
+#include <resumable/work_stealing.hpp>
+
+auto counter(resumable_stealing_scheduler& sched, std::atomic<long>& sum, int n)
+{
+  return [&sched, &sum, n, i = int(0)]() resumable
+  {
+    for (i = 1; i <= n; ++i)
+    {
+      sum.fetch_add(i, std::memory_order_relaxed);
+
+      // A second post while the task is running has no further effect.
+      sched.post(lambda_ref(lambda_this));
+      yield sched.post(lambda_ref(lambda_this));
+    }
+  };
+}
+
+typedef decltype(counter(std::declval<resumable_stealing_scheduler&>(),
+  std::declval<std::atomic<long>&>(), 0)) counter_type;
+
+int main()
+{
+  std::atomic<long> sum(0);
+  std::deque<resumable_task<counter_type>> tasks;
+
+  resumable_stealing_scheduler sched(4);
+  for (int i = 0; i < 1000; ++i)
+    tasks.emplace_back(counter(sched, sum, i % 100));
+  for (auto& t : tasks)
+    sched.post(t);
+  sched.wait();
+
+  int terminal = 0;
+  for (auto& t : tasks)
+    terminal += is_terminal(t);
+  printf("%ld %d\n", sum.load(), terminal);
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <utility>
+#include <resumable/tee.hpp>
+
+int main()
+{
+  int calls = 0;
+
+  auto numbers = [&calls, i = int(0)]() resumable -> int
+  {
+    while (++i < 200)
+    {
+      ++calls;
+      yield i;
+    }
+    ++calls;
+    return i;
+  };
+
+  resumable_shared_generator<decltype(numbers)> shared(std::move(numbers));
+  auto a = shared.make_reader();
+  auto b = shared.make_reader();
+
+  int sum_a = 0;
+  for (int k = 0; k < 150; ++k)
+    sum_a += a();
+  printf("%d\n", static_cast<int>(shared.buffered()));
+
+  // Once b has passed the first chunk, it is released.
+  int sum_b = 0;
+  for (int k = 0; k < 100; ++k)
+    sum_b += b();
+  printf("%d\n", static_cast<int>(shared.buffered()));
+
+  auto c = b;
+  while (!is_terminal(a))
+    sum_a += a();
+  while (!is_terminal(b))
+    sum_b += b();
+  int sum_c = 0;
+  while (!is_terminal(c))
+    sum_c += c();
+
+  printf("%d %d %d\n", sum_a, sum_b, sum_c);
+  printf("%d\n", calls);
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+
+class mailbox;
+
+struct mailbox_init
+{
+  typedef mailbox generator_type;
+};
+
+class mailbox
+{
+public:
+  mailbox() {}
+  mailbox(const mailbox&) = delete;
+  mailbox(mailbox&&) = delete;
+  mailbox& operator=(const mailbox&) = delete;
+  mailbox& operator=(mailbox&&) = delete;
+
+  void construct(mailbox_init&&) {}
+  void destroy() {}
+
+  int operator()()
+  {
+    if (full_)
+      done_ = true;
+    return value_;
+  }
+
+  bool is_terminal() const noexcept
+  {
+    return done_;
+  }
+
+  void* wanted() noexcept
+  {
+    return full_ ? nullptr : this;
+  }
+
+  const void* wanted() const noexcept
+  {
+    return full_ ? nullptr : this;
+  }
+
+  void put(int value)
+  {
+    value_ = value;
+    full_ = true;
+  }
+
+private:
+  int value_ = 0;
+  bool full_ = false;
+  bool done_ = false;
+};
+
+mailbox_init receive()
+{
+  return {};
+}
+
+int main()
+{
+  auto reader = []() resumable
+  {
+    int a, b;
+    a = yield from receive();
+    b = yield from receive();
+    printf("%d + %d = %d\n", a, b, a + b);
+  };
+
+  auto f = [&]() resumable
+  {
+    yield from reader;
+  };
+
+  int next = 1;
+  f();
+  while (!is_terminal(f))
+  {
+    if (mailbox* m = wanted_as<mailbox>(f))
+    {
+      printf("put %d\n", next);
+      m->put(next++);
+    }
+    f();
+  }
+}
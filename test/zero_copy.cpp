@@ -0,0 +1,39 @@
+#include <stdio.h>
+
+struct message
+{
+  explicit message(int i) : id(i) {}
+  message(const message& m) : id(m.id) { printf("copying %d\n", id); }
+  message(message&& m) : id(m.id) { printf("moving %d\n", id); }
+  int id;
+  char payload[4096];
+};
+
+auto source()
+{
+  return []() resumable
+  {
+    yield message(1);
+    yield message(2);
+    return message(3);
+  };
+}
+
+auto relay()
+{
+  return []() resumable -> message
+  {
+    return from source();
+  };
+}
+
+int main()
+{
+  auto f = []() resumable -> message
+  {
+    return from relay();
+  };
+
+  while (!is_terminal(f))
+    printf("%d\n", f().id);
+}